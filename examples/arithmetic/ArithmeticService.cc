@@ -6,35 +6,24 @@ class ArithmeticService : public ArithmeticServiceStub<ArithmeticService> {
 
 public:
     explicit ArithmeticService(RpcServer& server)
-            : ArithmeticServiceStub(server), pool_(4)
+            : ArithmeticServiceStub(server)
     {}
 
     void Add(double lhs, double rhs, const UserDoneCallback& callback) {
-        pool_.runTask([=](){
-            callback(mudong::json::Value(static_cast<double>(lhs + rhs)));
-        });
+        callback(mudong::json::Value(static_cast<double>(lhs + rhs)));
     }
 
     void Sub(double lhs, double rhs, const UserDoneCallback& callback) {
-        pool_.runTask([=](){
-            callback(mudong::json::Value(static_cast<double>(lhs - rhs)));
-        });
+        callback(mudong::json::Value(static_cast<double>(lhs - rhs)));
     }
 
     void Mul(double lhs, double rhs, const UserDoneCallback& callback) {
-        pool_.runTask([=](){
-            callback(mudong::json::Value(static_cast<double>(lhs * rhs)));
-        });
+        callback(mudong::json::Value(static_cast<double>(lhs * rhs)));
     }
 
     void Div(double lhs, double rhs, const UserDoneCallback& callback) {
-        pool_.runTask([=](){
-            callback(mudong::json::Value(static_cast<double>(lhs / rhs)));
-        });
+        callback(mudong::json::Value(static_cast<double>(lhs / rhs)));
     }
-
-private:
-    ThreadPool pool_;
 }; // ArithmeticServer
 
 int main() {
@@ -42,6 +31,7 @@ int main() {
     InetAddress addr(9877);
 
     RpcServer rpcServer(&loop, addr);
+    rpcServer.setNumWorkerThread(4); // spec.json中声明为"pool"的方法在这4个线程中执行
     ArithmeticService service(rpcServer);
 
     rpcServer.start();
@@ -1,15 +1,15 @@
-#include <mudong-json/include/Document.hpp>
-#include <mudong-json/include/StringWriteStream.hpp>
-#include <mudong-json/include/Writer.hpp>
+#include <algorithm>
 
 #include "client/BaseClient.hpp"
 #include "utils/Exception.hpp"
+#include "codec/Message.hpp"
 
 using namespace mudong::rpc;
 
 namespace {
 
 const size_t kMaxMessageLen = 65536;
+const size_t kUploadHighWaterMark = 65536;
 
 mudong::json::Value& findValue(mudong::json::Value& value, const char* key, mudong::json::ValueType type) {
     auto it = value.findMember(key);
@@ -35,52 +35,307 @@ mudong::json::Value& findValue(mudong::json::Value& value, const char* key, mudo
 } // anonymous namespace
 
 BaseClient::BaseClient(EventLoop* loop, const InetAddress& serverAddress)
-        : id_(0),
-          client_(loop, serverAddress)
+        : loop_(loop),
+          id_(0),
+          callTimeout_(0),
+          frameType_(FrameType::TEXT),
+          codec_(Codec::JSON),
+          compressThreshold_(kNoCompression),
+          serverAcceptsCompression_(false),
+          tcpClient_(std::make_unique<TcpClient>(loop, serverAddress)),
+          methodIdsEnabled_(false)
 {
-    client_.setMessageCallback(std::bind(&BaseClient::onMessage, this, _1, _2));
+    tcpClient_->setConnectionCallback(std::bind(&BaseClient::onConnection, this, _1));
+    tcpClient_->setMessageCallback(std::bind(&BaseClient::onMessage, this, _1, _2));
+}
+
+BaseClient::BaseClient(EventLoop* loop, const UnixAddress& serverAddress)
+        : loop_(loop),
+          id_(0),
+          callTimeout_(0),
+          frameType_(FrameType::TEXT),
+          codec_(Codec::JSON),
+          compressThreshold_(kNoCompression),
+          serverAcceptsCompression_(false),
+          unixClient_(std::make_unique<UnixClient>(loop, serverAddress)),
+          methodIdsEnabled_(false)
+{
+    unixClient_->setConnectionCallback(std::bind(&BaseClient::onConnection, this, _1));
+    unixClient_->setMessageCallback(std::bind(&BaseClient::onMessage, this, _1, _2));
+}
+
+BaseClient::~BaseClient() {
+    // 定时器回调绑定了this，析构后不能再触发
+    for (auto& [id, call] : callbacks_) {
+        if (call.timer != nullptr) {
+            loop_->cancelTimer(call.timer);
+        }
+    }
 }
 
 void BaseClient::start() {
-    client_.start();
+    if (tcpClient_ != nullptr) {
+        tcpClient_->start();
+    }
+    else {
+        unixClient_->start();
+    }
 }
 
 void BaseClient::setConnectionCallback(const ConnectionCallback& callback) {
-    client_.setConnectionCallback(callback);
+    connectionCallback_ = callback;
+}
+
+void BaseClient::setShmTransport(size_t ringSize) {
+    assert(unixClient_ != nullptr);
+    unixClient_->setHandshakeCallback([ringSize](EventLoop* loop, int connfd) -> std::any {
+        auto shm = ShmTransport::connect(loop, connfd, ringSize);
+        return shm != nullptr ? std::any(shm) : std::any();
+    });
+}
+
+void BaseClient::onConnection(const TcpConnectionPtr& conn) {
+    auto shm = std::any_cast<ShmTransportPtr>(&conn->getContext());
+    if (shm != nullptr) {
+        if (conn->connected()) {
+            // response从共享内存中读出，交给与socket相同的拆包逻辑
+            shm_ = *shm;
+            shm_->setMessageCallback([this, conn](Buffer& buffer) {
+                onMessage(conn, buffer);
+            });
+            shm_->start();
+        }
+        else {
+            (*shm)->close();
+            shm_.reset();
+        }
+    }
+
+    // 断开的连接上不会再收到response，未完成的调用立即以错误结束，而不是等到超时或永远挂起
+    if (!conn->connected()) {
+        failPendingCalls();
+    }
+
+    // id只在同一个server进程的生命周期内有效，重连后重新协商
+    methodIds_.clear();
+    writableCallbacks_.clear();
+    if (conn->connected() && methodIdsEnabled_) {
+        requestMethodIds(conn);
+    }
+    // server在连接断开时已经退订，新连接上重新订阅
+    if (conn->connected()) {
+        for (auto& topic : subscriptions_) {
+            sendSubscription(conn, kSubscribeMethod, topic, [topic](const mudong::json::Value&, bool isError, bool isTimeout) {
+                if (isError || isTimeout) {
+                    WARN("BaseClient::onConnection() resubscribe {} failed", topic);
+                }
+            });
+        }
+    }
+
+    if (connectionCallback_) {
+        connectionCallback_(conn);
+    }
+}
+
+void BaseClient::requestMethodIds(const TcpConnectionPtr& conn) {
+    mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
+    call.addMember("jsonrpc", "2.0");
+    call.addMember("method", kMethodIdsMethod);
+
+    // 协商完成之前发出的请求仍使用方法名，两者可以并存
+    sendCall(conn, call, [this](const mudong::json::Value& result, bool isError, bool isTimeout) {
+        if (isError || isTimeout || !result.isObject()) {
+            WARN("BaseClient::requestMethodIds() server does not support method ids, fall back to method names");
+            return;
+        }
+        for (auto& member : result.getObject()) {
+            if (member.value.isInt32()) {
+                methodIds_.emplace(member.key.getStringView(), member.value.getInt32());
+            }
+        }
+        DEBUG("BaseClient::requestMethodIds() got {} method ids", methodIds_.size());
+    });
+}
+
+mudong::json::Value BaseClient::methodKey(std::string_view method) const {
+    if (!methodIds_.empty()) {
+        auto it = methodIds_.find(method);
+        if (it != methodIds_.end()) {
+            return mudong::json::Value(it->second);
+        }
+    }
+    return mudong::json::Value(method);
 }
 
 //  带回调处理函数的request发送
 void BaseClient::sendCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback) {
+    sendCall(conn, call, callback, callTimeout_);
+}
+
+void BaseClient::sendCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback, std::chrono::milliseconds timeout) {
     // 收到response时调用callback，因此先将id号和对应callback存档
-    call.addMember("id", id_);
-    callbacks_[id_] = callback;
-    ++id_;
+    auto id = id_++;
+    call.addMember("id", id);
+
+    ev::Timer* timer = nullptr;
+    if (timeout > std::chrono::milliseconds::zero()) {
+        call.addMember("timeout", static_cast<int64_t>(timeout.count()));
+        timer = loop_->runAfter(timeout, [this, id]() { onCallTimeout(id); });
+    }
+    callbacks_[id] = PendingCall{callback, timer, nullptr};
+
+    sendRequest(conn, call);
+}
+
+void BaseClient::sendStreamCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ChunkCallback& onChunk, const ResponseCallback& callback) {
+    auto id = id_++;
+    call.addMember("id", id);
+    callbacks_[id] = PendingCall{callback, nullptr, onChunk};
 
     sendRequest(conn, call);
 }
 
+UploadWriter BaseClient::sendUploadCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback) {
+    auto id = id_++;
+    call.addMember("id", id);
+    callbacks_[id] = PendingCall{callback, nullptr, nullptr};
+
+    sendRequest(conn, call);
+    return UploadWriter(*this, conn, id);
+}
+
+bool UploadWriter::write(const mudong::json::Value& chunk) const {
+    mudong::json::Value message(mudong::json::ValueType::TYPE_OBJECT);
+    message.addMember("jsonrpc", "2.0");
+    message.addMember("id", id_);
+    message.addMember("stream", chunk);
+    client_.sendRequest(conn_, message);
+    return client_.writable(conn_);
+}
+
+void UploadWriter::onWritable(std::function<void()> callback) const {
+    client_.whenWritable(conn_, std::move(callback));
+}
+
+void UploadWriter::end() const {
+    mudong::json::Value message(mudong::json::ValueType::TYPE_OBJECT);
+    message.addMember("jsonrpc", "2.0");
+    message.addMember("id", id_);
+    message.addMember("end", true);
+    client_.sendRequest(conn_, message);
+}
+
+// 共享内存传输的队列满时由ShmTransport自行暂存，这里只看socket的输出缓冲
+bool BaseClient::writable(const TcpConnectionPtr& conn) const {
+    return shm_ != nullptr || conn->outputBuffer().readableBytes() < kUploadHighWaterMark;
+}
+
+void BaseClient::whenWritable(const TcpConnectionPtr& conn, std::function<void()> callback) {
+    if (writable(conn) || !conn->connected()) {
+        loop_->queueInLoop(std::move(callback));
+        return;
+    }
+    // 只在有上传等待时才注册，平时的请求不必为每次写完付出一次回调
+    if (writableCallbacks_.empty()) {
+        conn->setWriteCompleteCallback(std::bind(&BaseClient::onWriteComplete, this, _1));
+    }
+    writableCallbacks_.push_back(std::move(callback));
+}
+
+void BaseClient::onWriteComplete(const TcpConnectionPtr& conn) {
+    conn->setWriteCompleteCallback(ev::WriteCompleteCallback());
+    std::vector<std::function<void()>> callbacks;
+    callbacks.swap(writableCallbacks_);
+    for (auto& callback : callbacks) {
+        callback();
+    }
+}
+
+void BaseClient::onCallTimeout(int64_t id) {
+    auto it = callbacks_.find(id);
+    if (it == callbacks_.end()) return;
+
+    // 先移出再回调，之后到达的response找不到callback而被丢弃
+    auto callback = std::move(it->second.callback);
+    callbacks_.erase(it);
+    callback(mudong::json::Value(), false, true);
+}
+
+void BaseClient::failPendingCalls() {
+    // 先整体移出再回调，回调中发出的新调用不受影响
+    Callbacks callbacks;
+    callbacks.swap(callbacks_);
+    for (auto& [id, call] : callbacks) {
+        if (call.timer != nullptr) {
+            loop_->cancelTimer(call.timer);
+        }
+        auto response = errorResponse(mudong::json::Value(id), RpcError(ERROR::RPC_INTERNAL_ERROR), "connection closed");
+        call.callback(response["error"], true, false);
+    }
+}
+
+void CallAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    // 协程可能运行在其他线程（如server的IO线程或worker线程），id_和callbacks_只能在client的IO线程中修改，
+    // 因此请求投递到该线程发出。回调中恢复协程之后本对象可能随协程帧一起销毁，因此恢复是回调的最后一步
+    client_.loop_->runInLoop([this, handle]() {
+        client_.sendCall(conn_, call_, [this, handle](const mudong::json::Value& value, bool isError, bool isTimeout) {
+            result_ = CallResult{value, isError, isTimeout};
+            handle.resume();
+        });
+    });
+}
+
 void BaseClient::sendNotify(const TcpConnectionPtr& conn, mudong::json::Value& notify) {
     sendRequest(conn, notify);
 }
 
-void BaseClient::sendRequest(const TcpConnectionPtr& conn, mudong::json::Value& request) {
-    mudong::json::StringWriteStream os;
-    mudong::json::Writer writer(os);
-    request.writeTo(writer); // json格式的请求序列化
+void BaseClient::setNotifyCallback(std::string_view topic, const NotifyCallback& callback) {
+    notifyCallbacks_[std::string(topic)] = callback;
+}
+
+void BaseClient::subscribe(const TcpConnectionPtr& conn, std::string_view topic, const ResponseCallback& callback) {
+    if (std::find(subscriptions_.begin(), subscriptions_.end(), topic) == subscriptions_.end()) {
+        subscriptions_.emplace_back(topic);
+    }
+    sendSubscription(conn, kSubscribeMethod, topic, callback);
+}
+
+void BaseClient::unsubscribe(const TcpConnectionPtr& conn, std::string_view topic, const ResponseCallback& callback) {
+    auto it = std::find(subscriptions_.begin(), subscriptions_.end(), topic);
+    if (it != subscriptions_.end()) {
+        subscriptions_.erase(it);
+    }
+    sendSubscription(conn, kUnsubscribeMethod, topic, callback);
+}
+
+void BaseClient::sendSubscription(const TcpConnectionPtr& conn, std::string_view method, std::string_view topic, const ResponseCallback& callback) {
+    mudong::json::Value params(mudong::json::ValueType::TYPE_OBJECT);
+    params.addMember("topic", topic);
+
+    mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
+    call.addMember("jsonrpc", "2.0");
+    call.addMember("method", method);
+    call.addMember("params", params);
+    sendCall(conn, call, callback);
+}
 
-    auto message = std::to_string(os.getStringView().length() + 2)
-            .append("\r\n")
-            .append(os.getStringView())
-            .append("\r\n");
-    
-    /* message有header和body两部分组成
-    header: body的长度
-    body: response + crlf分隔符
+void BaseClient::sendRequest(const TcpConnectionPtr& conn, mudong::json::Value& request) {
+    bool compression = compressThreshold_ != kNoCompression;
+    // 文本帧只能承载json，且没有flags字段，无法协商压缩
+    auto type = codec_ == Codec::JSON && !compression ? frameType_ : FrameType::BINARY;
+    uint8_t flags = compression ? kFrameAcceptCompression : 0;
+    size_t threshold = serverAcceptsCompression_ ? compressThreshold_ : kNoCompression;
 
-    内存分布：header + "\r\n" + body + "\r\n"
-    */
+    std::string message;
+    encodeMessage(message, type, codec_, request, flags, threshold); // 请求直接序列化进帧内存，格式见codec/Frame.hpp
 
-    conn->send(message); // 将序列化的消息发送给serverAddress
+    if (shm_ != nullptr) {
+        shm_->send(message);
+    }
+    else {
+        conn->send(message); // 将序列化的消息发送给serverAddress
+    }
 }
 
 void BaseClient::onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
@@ -93,7 +348,13 @@ void BaseClient::onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
         errMsg.append("response error: ").append(e.what()).append(", and this request will be abandoned.");
         if (e.hasId()) {
             errMsg += " id: " + std::to_string(e.Id());
-            callbacks_.erase(e.Id());
+            auto it = callbacks_.find(e.Id());
+            if (it != callbacks_.end()) {
+                if (it->second.timer != nullptr) {
+                    loop_->cancelTimer(it->second.timer);
+                }
+                callbacks_.erase(it);
+            }
         }
         ERROR(errMsg);
     }
@@ -101,36 +362,42 @@ void BaseClient::onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
 
 void BaseClient::handleMessage(Buffer& buffer) {
     while (true) {
-        auto crlf = buffer.findCRLF();
-        if (crlf == nullptr) break;
-
-        size_t headerLen = crlf - buffer.peek() + 2; // bodyLength + "\r\n"
+        FrameHeader frame;
+        auto err = decodeFrameHeader(buffer.peek(), buffer.readableBytes(), kMaxMessageLen, frame);
+        if (err == FrameError::INCOMPLETE) break;
 
-        mudong::json::Document header;
-        auto err = header.parse(buffer.peek(), headerLen); // 反序列化header
-        if (err != mudong::json::ParseError::PARSE_OK || !header.isInt32() || header.getInt32() <= 0) {
-            buffer.retrieve(headerLen);
-            throw ResponseException("invalid message length in header");
+        if (err == FrameError::TOO_LONG) {
+            throw ResponseException(frameErrorStr(err));
         }
+        if (err != FrameError::OK) {
+            buffer.retrieve(std::min(frame.headerLen, buffer.readableBytes())); // 丢弃非法header
+            throw ResponseException(frameErrorStr(err));
+        }
+
+        if (buffer.readableBytes() < frame.headerLen + frame.bodyLen) break; // body还没收全，等待后续数据
 
-        auto bodyLen = static_cast<uint32_t>(header.getInt32());
-        if (bodyLen >= kMaxMessageLen) {
-            throw ResponseException("message is too long");
+        if (frame.flags & kFrameAcceptCompression) {
+            serverAcceptsCompression_ = true;
         }
 
-        if (buffer.readableBytes() < headerLen + bodyLen) break; // message实际长度小于header中记录的长度，直接丢弃，做报废处理
-        buffer.retrieve(headerLen);
-        auto json = buffer.retrieveAsString(bodyLen);
-        handleResponse(json); // body交由下层继续处理，这里只负责拆包逻辑
-        // message处理完就跳出循环
+        // body在buffer中原地解析，处理完再释放；出错时同样丢弃该帧
+        std::string_view body(buffer.peek() + frame.headerLen, frame.bodyLen);
+        try {
+            handleResponse(frame, body); // body交由下层继续处理，这里只负责拆包逻辑
+        }
+        catch (...) {
+            buffer.retrieve(frame.headerLen + frame.bodyLen);
+            throw;
+        }
+        buffer.retrieve(frame.headerLen + frame.bodyLen);
     }
 }
 
-void BaseClient::handleResponse(std::string& json) {
-    mudong::json::Document response;
-    auto err = response.parse(json);
-    if (err != mudong::json::ParseError::PARSE_OK) {
-        throw ResponseException(mudong::json::parseErrorStr(err));
+void BaseClient::handleResponse(const FrameHeader& frame, std::string_view body) {
+    mudong::json::Value response;
+    auto err = decodeMessage(frame, body, kMaxMessageLen, response);
+    if (err != nullptr) {
+        throw ResponseException(err);
     }
 
     switch (response.getType()) {
@@ -155,6 +422,12 @@ void BaseClient::handleResponse(std::string& json) {
 }
 
 void BaseClient::handleSingleResponse(mudong::json::Value& response) {
+    // 带method的是server主动推送的通知，没有id，不对应任何调用
+    if (response.isObject() && response.findMember("method") != response.endMember()) {
+        handleServerNotify(response);
+        return;
+    }
+
     validateResponse(response);
     auto id = response["id"].getInt32();
 
@@ -164,15 +437,32 @@ void BaseClient::handleSingleResponse(mudong::json::Value& response) {
         return;
     }
 
+    // 流式响应中的一块，调用仍未结束
+    auto chunk = response.findMember("stream");
+    if (chunk != response.endMember()) {
+        if (it->second.onChunk) {
+            it->second.onChunk(chunk->value);
+        }
+        else {
+            WARN("unexpected stream chunk for call {}", id);
+        }
+        return;
+    }
+
+    if (it->second.timer != nullptr) {
+        loop_->cancelTimer(it->second.timer);
+    }
+
+    auto& callback = it->second.callback;
     auto result = response.findMember("result");
     if (result != response.endMember()) {
-        it->second(result->value, false, false); // 后两个bool标志位 isError, isTimeout
+        callback(result->value, false, false); // 后两个bool标志位 isError, isTimeout
     }
     else {
         auto error = response.findMember("error");
         assert(error != response.endMember()); // 本不该不为error，因此debug模式下加此断言
         if (error != response.endMember()) {
-            it->second(error->value, true, false); // 对于release版本，实在是错误，那么就抛弃此response，request退化为notify
+            callback(error->value, true, false); // 对于release版本，实在是错误，那么就抛弃此response，request退化为notify
         }
         else {
             ERROR("response error, this response will be abandoned, id: {}", id);
@@ -181,10 +471,25 @@ void BaseClient::handleSingleResponse(mudong::json::Value& response) {
     callbacks_.erase(it);
 }
 
+void BaseClient::handleServerNotify(mudong::json::Value& notify) {
+    auto method = notify.findMember("method");
+    auto params = notify.findMember("params");
+    if (!method->value.isString() || params == notify.endMember()) {
+        throw ResponseException("bad server notify");
+    }
+
+    auto it = notifyCallbacks_.find(method->value.getStringView());
+    if (it == notifyCallbacks_.end()) {
+        DEBUG("BaseClient::handleServerNotify() no callback for {}", method->value.getStringView());
+        return;
+    }
+    it->second(params->value);
+}
+
 // 检查response的字段是否都合法且符合预期
 void BaseClient::validateResponse(mudong::json::Value& response) {
     if (response.getSize() != 3) {
-        throw ResponseException("response should have exactly 3 fields: (jsonrpc, error/result, id)");
+        throw ResponseException("response should have exactly 3 fields: (jsonrpc, error/result/stream, id)");
     }
 
     auto id = findValue(response, "id", mudong::json::ValueType::TYPE_INT32).getInt32();
@@ -196,6 +501,7 @@ void BaseClient::validateResponse(mudong::json::Value& response) {
     }
 
     if (response.findMember("result") != response.endMember()) return;
+    if (response.findMember("stream") != response.endMember()) return;
 
     findValue(response, "error", mudong::json::ValueType::TYPE_OBJECT, id);
 }
\ No newline at end of file
@@ -1,41 +1,215 @@
 #pragma once
 
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include <mudong-json/include/Value.hpp>
 
 #include "utils/util.hpp"
+#include "codec/Frame.hpp"
+#include "client/UnixClient.hpp"
+#include "shm/ShmTransport.hpp"
 
 namespace mudong {
 
 namespace rpc {
 
 using ResponseCallback = std::function<void(const mudong::json::Value, bool isError, bool isTimeout)>;
+using ChunkCallback = std::function<void(const mudong::json::Value& chunk)>; // 流式响应中的一块，见StreamWriter
+using NotifyCallback = std::function<void(mudong::json::Value& params)>;      // server推送的通知，见server/PubSub.hpp
+
+class BaseClient;
+
+// co_await一次调用得到的结果，含义与ResponseCallback的参数相同
+struct CallResult {
+    mudong::json::Value value;
+    bool isError;
+    bool isTimeout;
+};
+
+/* 由BaseClient::call返回，co_await时发出请求并挂起，收到响应或超时后在client的IO线程中恢复等待的协程。
+可在任意线程中co_await：请求投递到client的IO线程发出，协程之后也在该线程中继续执行
+ */
+class CallAwaiter {
+
+public:
+    CallAwaiter(BaseClient& client, const TcpConnectionPtr& conn, mudong::json::Value call)
+            : client_(client),
+              conn_(conn),
+              call_(std::move(call))
+    {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    CallResult await_resume() {
+        return std::move(result_);
+    }
+
+private:
+    BaseClient& client_;
+    TcpConnectionPtr conn_;
+    mudong::json::Value call_;
+    CallResult result_{mudong::json::Value(), false, false};
+}; // class CallAwaiter
+
+/* 由BaseClient::sendUploadCall返回，以同一个调用id逐块上传数据，见server/StreamReader.hpp。
+只能在client的IO线程中使用；服务端收到end之后才会回复，调用的结果仍由sendUploadCall的callback得到
+ */
+class UploadWriter {
+
+public:
+    UploadWriter(BaseClient& client, const TcpConnectionPtr& conn, int64_t id)
+            : client_(client),
+              conn_(conn),
+              id_(id)
+    {}
+
+    // 发送一块数据；返回false表示连接上待发送的数据已超过高水位，此时应暂停，在onWritable的callback中继续
+    bool write(const mudong::json::Value& chunk) const;
+
+    // callback在client的IO线程中执行，当前已经可写时也推迟到本轮事件循环末尾执行
+    void onWritable(std::function<void()> callback) const;
+
+    // 所有数据已经发送完毕，之后不能再write
+    void end() const;
+
+private:
+    BaseClient& client_;
+    TcpConnectionPtr conn_;
+    int64_t id_;
+}; // class UploadWriter
 
 class BaseClient : noncopyable {
 
 public:
     BaseClient(EventLoop* loop, const InetAddress& serverAddress);
+    BaseClient(EventLoop* loop, const UnixAddress& serverAddress); // 通过unix socket连接同一主机上的server
+    ~BaseClient();
 
     void start();
 
     void setConnectionCallback(const ConnectionCallback& callback);
 
+    // 请求使用的帧类型，默认为文本帧以兼容旧版本服务端；server会以相同帧类型回复
+    void setFrameType(FrameType type) {
+        frameType_ = type;
+    }
+
+    // 请求body的编码方式，默认为json；非json编码只能通过二进制帧承载，server会以相同编码回复
+    void setCodec(Codec codec) {
+        codec_ = codec;
+    }
+
+    // 请求body不小于threshold时压缩后发送，默认不压缩。开启后同时声明自己能够解压，server可以压缩响应；
+    // 请求只有在收到过server声明能够解压的帧之后才会被压缩，旧版本server不受影响。压缩只用于二进制帧
+    void setCompressThreshold(size_t threshold) {
+        compressThreshold_ = threshold;
+    }
+
+    // 只对unix socket生效，server需以listenShm监听该地址。连接建立后改用共享内存传输，ringSize为每个方向队列的字节数，须为2的幂
+    void setShmTransport(size_t ringSize);
+
+    // 开启后每次连接建立时先调用rpc.methods获取server的方法id，之后methodKey返回数字id，请求更短、server分发只需一次数组下标；
+    // 旧版本server不支持时调用失败，仍使用方法名
+    void setMethodIds(bool on) {
+        methodIdsEnabled_ = on;
+    }
+
+    // 每个请求的超时时间，默认为0表示不超时。请求中附带"timeout"字段，server据此丢弃client已经放弃的请求；
+    // 超时仍未收到响应时以isTimeout为true调用callback，之后到达的响应被丢弃
+    void setCallTimeout(std::chrono::milliseconds timeout) {
+        callTimeout_ = timeout;
+    }
+
+    // stub构造请求时用作"method"字段的值：已协商到id时为数字id，否则为方法名本身
+    mudong::json::Value methodKey(std::string_view method) const;
+
     void sendCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback);
+    void sendCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback, std::chrono::milliseconds timeout);
+
+    // 调用流式返回的方法，每收到一块调用一次onChunk，全部收完后以块数为result调用callback。
+    // 不使用setCallTimeout的超时，传输大量数据的调用耗时与数据量相关
+    void sendStreamCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ChunkCallback& onChunk, const ResponseCallback& callback);
+
+    // 调用流式上传的方法，call为打开调用的请求，数据之后通过返回的UploadWriter逐块发送，服务端收齐后以callback回复。
+    // 与流式返回相同，不使用setCallTimeout的超时
+    UploadWriter sendUploadCall(const TcpConnectionPtr& conn, mudong::json::Value& call, const ResponseCallback& callback);
 
     void sendNotify(const TcpConnectionPtr& conn, mudong::json::Value& notify);
 
+    // 收到server推送的topic通知时在IO线程中调用callback，没有设置callback的通知被丢弃
+    void setNotifyCallback(std::string_view topic, const NotifyCallback& callback);
+
+    // 订阅server推送的topic，callback得到server的确认。订阅属于连接，重连之后自动重新订阅
+    void subscribe(const TcpConnectionPtr& conn, std::string_view topic, const ResponseCallback& callback);
+    void unsubscribe(const TcpConnectionPtr& conn, std::string_view topic, const ResponseCallback& callback);
+
+    // 协程风格的调用，co_await返回的对象即发出请求并等待结果
+    CallAwaiter call(const TcpConnectionPtr& conn, mudong::json::Value request) {
+        return CallAwaiter(*this, conn, std::move(request));
+    }
+
 private:
+    friend class UploadWriter;
+    friend class CallAwaiter;
+
+    void onConnection(const TcpConnectionPtr& conn);
     void onMessage(const TcpConnectionPtr& conn, Buffer& buffer);
     void handleMessage(Buffer& buffer);
-    void handleResponse(std::string& json);
+    void handleResponse(const FrameHeader& frame, std::string_view body);
     void handleSingleResponse(mudong::json::Value& response);
+    void handleServerNotify(mudong::json::Value& notify);
+    void sendSubscription(const TcpConnectionPtr& conn, std::string_view method, std::string_view topic, const ResponseCallback& callback);
     void validateResponse(mudong::json::Value& response);
     void sendRequest(const TcpConnectionPtr& conn, mudong::json::Value& request);
+    void requestMethodIds(const TcpConnectionPtr& conn);
+    void onCallTimeout(int64_t id);
+    void failPendingCalls();
+    bool writable(const TcpConnectionPtr& conn) const;
+    void whenWritable(const TcpConnectionPtr& conn, std::function<void()> callback);
+    void onWriteComplete(const TcpConnectionPtr& conn);
 
 private:
-    using Callbacks = std::unordered_map<int64_t, ResponseCallback>;
+    struct PendingCall {
+        ResponseCallback callback;
+        ev::Timer* timer;      // 超时定时器，不超时的请求为nullptr
+        ChunkCallback onChunk; // 只有流式调用才有
+    };
+    using Callbacks = std::unordered_map<int64_t, PendingCall>;
+    EventLoop* loop_;
     int64_t id_;
+    std::chrono::milliseconds callTimeout_;
+    FrameType frameType_;
+    Codec codec_;
+    size_t compressThreshold_;
+    bool serverAcceptsCompression_;
     Callbacks callbacks_;
-    TcpClient client_;
+    // 二者只有一个非空，由构造时的地址类型决定
+    std::unique_ptr<TcpClient> tcpClient_;
+    std::unique_ptr<UnixClient> unixClient_;
+    ShmTransportPtr shm_;  // 当前连接使用的共享内存传输，没有时为空
+    ConnectionCallback connectionCallback_;
+    std::vector<std::function<void()>> writableCallbacks_; // 等待连接可写的上传，断开时丢弃
+
+    bool methodIdsEnabled_;
+    // 透明哈希，按string_view查找时无需构造string
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>()(name);
+        }
+    };
+    std::unordered_map<std::string, int32_t, NameHash, std::equal_to<>> methodIds_; // 方法名 -> 当前连接上协商得到的id，断开时清空
+    std::unordered_map<std::string, NotifyCallback, NameHash, std::equal_to<>> notifyCallbacks_; // topic -> callback
+    std::vector<std::string> subscriptions_; // 已订阅的topic，重连后据此重新订阅
 }; // class BaseClient
 
 } // namespace rpc
@@ -0,0 +1,94 @@
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "client/UnixClient.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const auto kRetryDelay = 1s;
+
+} // anonymous namespace
+
+UnixClient::UnixClient(EventLoop* loop, const UnixAddress& peer)
+        : loop_(loop),
+          peer_(peer),
+          dummyAddress_(0, true),
+          retryTimer_(nullptr),
+          stopped_(false)
+{}
+
+UnixClient::~UnixClient() {
+    stopped_ = true;
+    if (connection_ != nullptr && !connection_->disconnected()) {
+        // 连接在forceClose之后才真正关闭，此时this已经析构，close callback不能再回到UnixClient
+        connection_->setCloseCallback([](const TcpConnectionPtr&) {});
+        connection_->forceClose();
+    }
+    if (retryTimer_ != nullptr) {
+        loop_->cancelTimer(retryTimer_);
+    }
+}
+
+void UnixClient::start() {
+    loop_->runInLoop(std::bind(&UnixClient::connect, this));
+}
+
+void UnixClient::connect() {
+    loop_->assertInLoopThread();
+    retryTimer_ = nullptr;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        SYSFATAL("UnixClient::socket()");
+    }
+    // unix socket的connect不存在三次握手，要么立即成功，要么失败（对端未监听或backlog已满），失败时稍后重试
+    if (::connect(fd, peer_.getSockaddr(), peer_.getSocklen()) == -1) {
+        WARN("UnixClient::connect() {} failed: {}, retry in {}s", peer_.path(), strerror(errno), kRetryDelay.count());
+        ::close(fd);
+        retry();
+        return;
+    }
+
+    std::any context;
+    if (handshakeCallback_) {
+        context = handshakeCallback_(loop_, fd);
+        if (!context.has_value()) {
+            WARN("UnixClient::connect() {} handshake failed, retry in {}s", peer_.path(), kRetryDelay.count());
+            ::close(fd);
+            retry();
+            return;
+        }
+    }
+    newConnection(fd, context);
+}
+
+void UnixClient::retry() {
+    if (stopped_) return;
+    retryTimer_ = loop_->runAfter(kRetryDelay, std::bind(&UnixClient::connect, this));
+}
+
+void UnixClient::newConnection(int connfd, const std::any& context) {
+    auto conn = std::make_shared<TcpConnection>(loop_, connfd, dummyAddress_, dummyAddress_);
+    conn->setContext(context);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&UnixClient::closeConnection, this, _1));
+    connection_ = conn;
+
+    conn->connectEstablished();
+    connectionCallback_(conn);
+}
+
+void UnixClient::closeConnection(const TcpConnectionPtr& conn) {
+    loop_->assertInLoopThread();
+    assert(conn == connection_);
+    connection_.reset();
+
+    connectionCallback_(conn);
+    retry();
+}
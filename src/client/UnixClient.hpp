@@ -0,0 +1,68 @@
+#pragma once
+
+#include <any>
+
+#include "utils/util.hpp"
+#include "utils/UnixAddress.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+class Timer;
+
+} // namespace ev
+
+namespace rpc {
+
+// 连接AF_UNIX流式套接字，接口与TcpClient保持一致，建立的连接同样是TcpConnection；连接失败或断开后定时重连
+class UnixClient : noncopyable {
+
+public:
+    // 同UnixServer::HandshakeCallback，返回空值表示握手失败，稍后重连
+    using HandshakeCallback = std::function<std::any(EventLoop* loop, int connfd)>;
+
+    UnixClient(EventLoop* loop, const UnixAddress& peer);
+    ~UnixClient();
+
+    void start();
+
+    void setConnectionCallback(const ConnectionCallback& cb) {
+        connectionCallback_ = cb;
+    }
+
+    void setMessageCallback(const ev::MessageCallback& cb) {
+        messageCallback_ = cb;
+    }
+
+    void setWriteCompleteCallback(const ev::WriteCompleteCallback& cb) {
+        writeCompleteCallback_ = cb;
+    }
+
+    void setHandshakeCallback(const HandshakeCallback& cb) {
+        handshakeCallback_ = cb;
+    }
+
+private:
+    void connect();
+    void retry();
+    void newConnection(int connfd, const std::any& context);
+    void closeConnection(const TcpConnectionPtr& conn);
+
+private:
+    EventLoop* loop_;
+    const UnixAddress peer_;
+    const InetAddress dummyAddress_; // 同UnixServer，unix socket没有ip和端口
+    TcpConnectionPtr connection_;
+    ev::Timer* retryTimer_;
+    bool stopped_; // 析构开始后不再重连，只在loop_所在线程中访问
+
+    ConnectionCallback connectionCallback_;
+    ev::MessageCallback messageCallback_;
+    ev::WriteCompleteCallback writeCompleteCallback_;
+    HandshakeCallback handshakeCallback_;
+}; // class UnixClient
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,163 @@
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#include "codec/Frame.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isKnownCodec(uint8_t codec) {
+    return codec == static_cast<uint8_t>(Codec::JSON) ||
+           codec == static_cast<uint8_t>(Codec::MSGPACK);
+}
+
+uint32_t readUint32(const char* p) {
+    auto u = reinterpret_cast<const unsigned char*>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) |
+           (static_cast<uint32_t>(u[1]) << 16) |
+           (static_cast<uint32_t>(u[2]) << 8)  |
+            static_cast<uint32_t>(u[3]);
+}
+
+void writeUint32(char* p, uint32_t n) {
+    p[0] = static_cast<char>((n >> 24) & 0xff);
+    p[1] = static_cast<char>((n >> 16) & 0xff);
+    p[2] = static_cast<char>((n >> 8) & 0xff);
+    p[3] = static_cast<char>(n & 0xff);
+}
+
+// 文本帧header: 正整数 + "\r\n"，允许数字前后有空白，与旧版本用json解析header的行为保持一致
+FrameError decodeTextHeader(const char* data, size_t len, size_t maxBodyLen, FrameHeader& header) {
+    auto crlf = static_cast<const char*>(::memmem(data, len, "\r\n", 2));
+    if (crlf == nullptr) return FrameError::INCOMPLETE;
+
+    header.headerLen = static_cast<size_t>(crlf - data) + 2; // +2为包含了crlf的长度
+    if (crlf == data) return FrameError::EMPTY_HEADER;
+
+    const char* p = data;
+    while (p < crlf && isBlank(*p)) ++p;
+
+    const char* digits = p;
+    uint64_t bodyLen = 0;
+    while (p < crlf && *p >= '0' && *p <= '9') {
+        bodyLen = bodyLen * 10 + static_cast<uint64_t>(*p - '0');
+        if (bodyLen > static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+            return FrameError::BAD_LENGTH; // 必须是一个int32的正数
+        }
+        ++p;
+    }
+    if (p == digits || (*digits == '0' && p - digits > 1)) return FrameError::BAD_LENGTH; // 无数字或有前导0
+
+    while (p < crlf && isBlank(*p)) ++p;
+    if (p != crlf || bodyLen == 0) return FrameError::BAD_LENGTH;
+    if (bodyLen > maxBodyLen) return FrameError::TOO_LONG;
+
+    header.flags = 0;
+    header.codec = Codec::JSON;
+    header.bodyLen = static_cast<size_t>(bodyLen);
+    return FrameError::OK;
+}
+
+// 二进制帧header定长，只需按偏移读取字段，O(1)
+FrameError decodeBinaryHeader(const char* data, size_t len, size_t maxBodyLen, FrameHeader& header) {
+    header.headerLen = kBinaryHeaderLen;
+    if (len >= 2 && data[1] != kFrameMagic1) return FrameError::BAD_MAGIC;
+    if (len < kBinaryHeaderLen) return FrameError::INCOMPLETE;
+
+    auto codec = static_cast<uint8_t>(data[3]);
+    if (!isKnownCodec(codec)) return FrameError::BAD_MAGIC;
+
+    uint32_t bodyLen = readUint32(data + 4);
+    if (bodyLen == 0) return FrameError::BAD_LENGTH;
+    if (bodyLen > maxBodyLen) return FrameError::TOO_LONG;
+
+    header.flags = static_cast<uint8_t>(data[2]);
+    header.codec = static_cast<Codec>(codec);
+    header.bodyLen = bodyLen;
+    return FrameError::OK;
+}
+
+} // anonymous namespace
+
+FrameError mudong::rpc::decodeFrameHeader(const char* data, size_t len, size_t maxBodyLen, FrameHeader& header) {
+    if (len == 0) return FrameError::INCOMPLETE;
+    // 首字节即可区分帧类型，出错时type和headerLen同样有效，便于调用方按原帧类型回复错误或丢弃header
+    if (data[0] == kFrameMagic0) {
+        header.type = FrameType::BINARY;
+        return decodeBinaryHeader(data, len, maxBodyLen, header);
+    }
+    header.type = FrameType::TEXT;
+    return decodeTextHeader(data, len, maxBodyLen, header);
+}
+
+FrameWriteStream::FrameWriteStream(std::string& output, FrameType type, Codec codec, uint8_t flags)
+        : output_(output),
+          type_(type),
+          headerPos_(output.size())
+{
+    if (type_ == FrameType::TEXT) {
+        output_.append(kTextHeaderLen, ' '); // 长度未知，先占位
+    }
+    else {
+        char header[kBinaryHeaderLen] = {
+            kFrameMagic0,
+            kFrameMagic1,
+            static_cast<char>(flags),
+            static_cast<char>(codec)
+        };
+        output_.append(header, kBinaryHeaderLen);
+    }
+}
+
+void FrameWriteStream::finish() {
+    char* header = output_.data() + headerPos_;
+
+    if (type_ == FrameType::TEXT) {
+        /* 内存分布：header + "\r\n" + body + "\r\n"
+        header: body的长度，body中包含末尾的crlf分隔符
+         */
+        output_.append("\r\n");
+        size_t bodyLen = output_.size() - headerPos_ - kTextHeaderLen;
+
+        char digits[kTextHeaderLen];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), bodyLen);
+        assert(ec == std::errc());
+        auto n = static_cast<size_t>(end - digits);
+        assert(n <= kTextHeaderLen - 2);
+
+        std::memcpy(header + kTextHeaderLen - 2 - n, digits, n);
+        header[kTextHeaderLen - 2] = '\r';
+        header[kTextHeaderLen - 1] = '\n';
+    }
+    else {
+        size_t bodyLen = output_.size() - headerPos_ - kBinaryHeaderLen;
+        writeUint32(header + 4, static_cast<uint32_t>(bodyLen));
+    }
+}
+
+void FrameWriteStream::replaceBody(const std::string& data, uint8_t flags) {
+    assert(type_ == FrameType::BINARY);
+    output_.resize(headerPos_ + kBinaryHeaderLen);
+    output_.append(data);
+
+    output_[headerPos_ + 2] = static_cast<char>(static_cast<uint8_t>(output_[headerPos_ + 2]) | flags);
+}
+
+const char* mudong::rpc::frameErrorStr(FrameError err) {
+    switch (err) {
+        case FrameError::OK:           return "ok";
+        case FrameError::INCOMPLETE:   return "incomplete frame";
+        case FrameError::EMPTY_HEADER: return "empty frame header";
+        case FrameError::BAD_MAGIC:    return "invalid frame header";
+        case FrameError::BAD_LENGTH:   return "invalid message length";
+        case FrameError::TOO_LONG:     return "message is too long";
+    }
+    return "unknown frame error";
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace mudong {
+
+namespace rpc {
+
+/* 帧格式
+文本帧：  header: body长度的ASCII十进制 + "\r\n"
+          body:   json + "\r\n"
+二进制帧：定长8字节header，多字节字段均为网络字节序，body为json本体，不再附带crlf
+
+ 0        1        2        3        4        5        6        7
++--------+--------+--------+--------+--------+--------+--------+--------+
+|  'M'   |  'R'   | flags  | codec  |          body length (u32)        |
++--------+--------+--------+--------+--------+--------+--------+--------+
+
+文本帧header的首字节只可能是数字或空白，与魔数首字节'M'不会冲突，因此接收端可以逐帧自动识别帧类型
+
+flags只在二进制帧中存在：
+COMPRESSED         body经过压缩，内容为u32的原始长度 + 压缩数据，见codec/Lz.hpp
+ACCEPT_COMPRESSION 发送方能够解压，对端据此决定之后发给它的帧是否压缩，旧版本不设置该位，因此不会收到压缩帧
+ */
+
+enum class FrameType : uint8_t {
+    TEXT,   // "len\r\n" + body，与旧版本兼容
+    BINARY, // 定长二进制header + body，拆包时无需任何解析
+};
+
+// body的编码方式，记录在二进制帧header的codec字段中，文本帧只能是JSON
+enum class Codec : uint8_t {
+    JSON = 0,
+    MSGPACK = 1, // 与json共用json::Value数据模型的二进制编码，见codec/MsgPack.hpp
+};
+
+enum class FrameError {
+    OK,
+    INCOMPLETE,   // header或body尚未收全，等待更多数据
+    EMPTY_HEADER, // 文本帧header为空行
+    BAD_MAGIC,
+    BAD_LENGTH,
+    TOO_LONG,
+};
+
+struct FrameHeader {
+    FrameType type;
+    uint8_t flags;
+    Codec codec;
+    size_t headerLen; // header所占字节数，包括文本帧的crlf
+    size_t bodyLen;
+};
+
+constexpr uint8_t kFrameCompressed = 0x01;
+constexpr uint8_t kFrameAcceptCompression = 0x02;
+
+constexpr char kFrameMagic0 = 'M';
+constexpr char kFrameMagic1 = 'R';
+constexpr size_t kBinaryHeaderLen = 8;
+constexpr size_t kTextHeaderLen = 12; // 定宽文本header：右对齐的10位十进制长度 + "\r\n"，左侧以空格补齐
+
+// 从data开始解析一个帧的header，返回OK时header中的内容全部有效，否则只有type和headerLen有效
+// OK并不代表body已收全，body完整性由调用方自行判断
+FrameError decodeFrameHeader(const char* data, size_t len, size_t maxBodyLen, FrameHeader& header);
+
+/* 满足mudong-json中WriteStream要求的输出流，Writer直接把body序列化到output末尾的帧内存中
+构造时先预留定长header，finish()时回填body长度，整个帧只写一次，无需再拼接header和body
+ */
+class FrameWriteStream {
+
+public:
+    FrameWriteStream(std::string& output, FrameType type, Codec codec, uint8_t flags);
+    FrameWriteStream(const FrameWriteStream&) = delete;
+    FrameWriteStream& operator=(const FrameWriteStream&) = delete;
+
+    void put(char c) {
+        output_.push_back(c);
+    }
+
+    void put(std::string_view str) {
+        output_.append(str);
+    }
+
+    // body写完后调用，回填header中的长度
+    void finish();
+
+    // 以下只对二进制帧有效，在finish()之前调用，用于压缩等对整个body的变换
+    // 用data替换已写入的body，并在header中追加flags
+    void replaceBody(const std::string& data, uint8_t flags);
+
+    std::string_view body() const {
+        return std::string_view(output_).substr(headerPos_ + kBinaryHeaderLen);
+    }
+
+private:
+    std::string& output_;
+    const FrameType type_;
+    const size_t headerPos_; // 本帧header在output中的起始偏移，output中可能已有其他帧
+}; // class FrameWriteStream
+
+const char* frameErrorStr(FrameError err);
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,174 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "codec/Lz.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;        // 块末尾至少保留5字节字面量
+const size_t kMatchSafeDistance = 12;  // 距离末尾不足12字节时不再查找匹配
+const size_t kMaxOffset = 65535;
+const size_t kRunMask = 15;
+const int kHashBits = 16;
+const int kSkipTrigger = 6;            // 连续多次找不到匹配时逐渐加大步长，不可压缩的数据也能快速跳过
+
+uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - kHashBits);
+}
+
+// 长度超过15的部分，以若干个255加一个余数字节表示
+void putLength(std::string& output, size_t len) {
+    while (len >= 255) {
+        output.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    output.push_back(static_cast<char>(len));
+}
+
+// matchLen为0表示最后一个只有字面量的sequence
+void putSequence(std::string& output, const char* literal, size_t literalLen, size_t offset, size_t matchLen) {
+    size_t tokenPos = output.size();
+    output.push_back(0);
+
+    unsigned token = 0;
+    if (literalLen >= kRunMask) {
+        token = kRunMask << 4;
+        putLength(output, literalLen - kRunMask);
+    }
+    else {
+        token = static_cast<unsigned>(literalLen << 4);
+    }
+    output.append(literal, literalLen);
+
+    if (matchLen > 0) {
+        output.push_back(static_cast<char>(offset & 0xff)); // offset为小端序
+        output.push_back(static_cast<char>((offset >> 8) & 0xff));
+
+        size_t len = matchLen - kMinMatch;
+        if (len >= kRunMask) {
+            token |= kRunMask;
+            putLength(output, len - kRunMask);
+        }
+        else {
+            token |= static_cast<unsigned>(len);
+        }
+    }
+    output[tokenPos] = static_cast<char>(token);
+}
+
+// 读取token之后的长度扩展字节，越界或超过limit时返回false
+bool getLength(const unsigned char*& ip, const unsigned char* iend, size_t limit, size_t& len) {
+    unsigned char c;
+    do {
+        if (ip == iend) return false;
+        c = *ip++;
+        len += c;
+        if (len > limit) return false;
+    } while (c == 255);
+    return true;
+}
+
+} // anonymous namespace
+
+size_t mudong::rpc::lzCompress(const char* src, size_t len, std::string& output) {
+    size_t start = output.size();
+    output.reserve(start + len + len / 255 + 16); // 最坏情况下的输出长度
+
+    size_t anchor = 0; // 尚未输出的字面量起点
+    if (len > kMatchSafeDistance) {
+        std::vector<uint32_t> table(size_t(1) << kHashBits, 0); // hash -> 最近一次出现的位置
+        const size_t limit = len - kMatchSafeDistance;
+        const size_t matchLimit = len - kLastLiterals;
+
+        size_t i = 1;
+        table[hash(read32(src))] = 0;
+        while (i < limit) {
+            uint32_t seq = read32(src + i);
+            uint32_t h = hash(seq);
+            size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(i);
+
+            if (i - candidate > kMaxOffset || read32(src + candidate) != seq) {
+                i += 1 + ((i - anchor) >> kSkipTrigger);
+                continue;
+            }
+
+            // 向前扩展匹配，吃掉一部分字面量
+            while (i > anchor && candidate > 0 && src[i - 1] == src[candidate - 1]) {
+                --i;
+                --candidate;
+            }
+            // 向后扩展匹配
+            size_t end = i + kMinMatch;
+            size_t ref = candidate + kMinMatch;
+            while (end < matchLimit && src[end] == src[ref]) {
+                ++end;
+                ++ref;
+            }
+
+            putSequence(output, src + anchor, i - anchor, i - candidate, end - i);
+            i = end;
+            anchor = i;
+            if (i - 2 < limit) {
+                table[hash(read32(src + i - 2))] = static_cast<uint32_t>(i - 2);
+            }
+        }
+    }
+    putSequence(output, src + anchor, len - anchor, 0, 0);
+    return output.size() - start;
+}
+
+bool mudong::rpc::lzDecompress(const char* src, size_t len, char* dst, size_t dstLen) {
+    auto ip = reinterpret_cast<const unsigned char*>(src);
+    const auto iend = ip + len;
+    char* op = dst;
+    char* const oend = dst + dstLen;
+
+    while (true) {
+        if (ip == iend) return false;
+        unsigned token = *ip++;
+
+        // 字面量
+        size_t literalLen = token >> 4;
+        if (literalLen == kRunMask && !getLength(ip, iend, dstLen, literalLen)) return false;
+        if (literalLen > static_cast<size_t>(iend - ip) || literalLen > static_cast<size_t>(oend - op)) return false;
+        std::memcpy(op, ip, literalLen);
+        ip += literalLen;
+        op += literalLen;
+
+        if (ip == iend) return op == oend; // 最后一个sequence只有字面量
+
+        // 回溯匹配
+        if (iend - ip < 2) return false;
+        size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) return false;
+
+        size_t matchLen = token & kRunMask;
+        if (matchLen == kRunMask && !getLength(ip, iend, dstLen, matchLen)) return false;
+        matchLen += kMinMatch;
+        if (matchLen > static_cast<size_t>(oend - op)) return false;
+
+        const char* ref = op - offset;
+        if (offset >= matchLen) {
+            std::memcpy(op, ref, matchLen);
+            op += matchLen;
+        }
+        else {
+            // 源与目的重叠，即重复模式，只能逐字节复制
+            for (size_t i = 0; i < matchLen; ++i) {
+                *op++ = *ref++;
+            }
+        }
+    }
+}
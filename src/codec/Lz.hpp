@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace mudong {
+
+namespace rpc {
+
+/* 内置的LZ77族快速压缩算法，块格式与LZ4 block format一致，不依赖任何外部库
+每个sequence由token、字面量和一次回溯匹配组成：
+
++-------+--------------+----------+-------------+--------------+
+| token | 字面量长度扩展 |  字面量   | offset(u16) | 匹配长度扩展  |
++-------+--------------+----------+-------------+--------------+
+
+token高4位为字面量长度，低4位为匹配长度减4，取值15时后续字节继续累加，遇到非255的字节结束；
+最后一个sequence只有字面量。只追求速度，压缩率依赖于数据本身的重复程度，json这类文本通常有数倍的压缩比
+ */
+
+// 将src压缩后追加到output末尾，返回追加的字节数
+size_t lzCompress(const char* src, size_t len, std::string& output);
+
+// 将src解压到dst，解压后的长度必须恰好为dstLen，数据非法或长度不符时返回false
+bool lzDecompress(const char* src, size_t len, char* dst, size_t dstLen);
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,156 @@
+#include <mudong-json/include/Document.hpp>
+#include <mudong-json/include/Writer.hpp>
+
+#include "codec/Message.hpp"
+#include "codec/MsgPack.hpp"
+#include "codec/Lz.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const size_t kRawLenBytes = 4; // 压缩body开头的原始长度，u32网络字节序
+
+// 压缩body，格式为原始长度 + 压缩数据；压缩后没有变小返回false
+bool compressBody(std::string_view body, std::string& compressed) {
+    auto n = static_cast<uint32_t>(body.length());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        compressed.push_back(static_cast<char>((n >> shift) & 0xff));
+    }
+    lzCompress(body.data(), body.length(), compressed);
+    return compressed.size() < body.length();
+}
+
+const char* decompressBody(std::string_view body, size_t maxBodyLen, std::string& raw) {
+    if (body.length() < kRawLenBytes) {
+        return "invalid compressed body";
+    }
+    size_t rawLen = 0;
+    for (size_t i = 0; i < kRawLenBytes; ++i) {
+        rawLen = (rawLen << 8) | static_cast<unsigned char>(body[i]);
+    }
+    if (rawLen == 0 || rawLen > maxBodyLen) {
+        return "invalid uncompressed length";
+    }
+
+    raw.resize(rawLen);
+    if (!lzDecompress(body.data() + kRawLenBytes, body.length() - kRawLenBytes, raw.data(), rawLen)) {
+        return "invalid compressed body";
+    }
+    return nullptr;
+}
+
+// 满足WriteStream要求，追加到string末尾
+class StringAppendStream {
+
+public:
+    explicit StringAppendStream(std::string& output)
+            : output_(output)
+    {}
+
+    void put(char c) {
+        output_.push_back(c);
+    }
+
+    void put(std::string_view str) {
+        output_.append(str);
+    }
+
+private:
+    std::string& output_;
+};
+
+// 文本帧没有flags字段，只有二进制帧可以压缩
+void finishMessage(FrameWriteStream& os, FrameType type, size_t compressThreshold) {
+    if (type == FrameType::BINARY && os.body().length() >= compressThreshold) {
+        std::string compressed;
+        if (compressBody(os.body(), compressed)) {
+            os.replaceBody(compressed, kFrameCompressed);
+        }
+    }
+    os.finish();
+}
+
+} // anonymous namespace
+
+void mudong::rpc::encodeMessage(std::string& output, FrameType type, Codec codec, const mudong::json::Value& value,
+                                uint8_t flags, size_t compressThreshold)
+{
+    assert(type == FrameType::BINARY || codec == Codec::JSON); // 文本帧只能承载json
+
+    FrameWriteStream os(output, type, codec, flags);
+    if (codec == Codec::MSGPACK) {
+        MsgPackWriter writer(output); // MsgPackWriter需要回填容器长度，直接操作帧内存
+        value.writeTo(writer);
+    }
+    else {
+        mudong::json::Writer writer(os); // 由writer操作向输出流os写
+        value.writeTo(writer); // 函数内部递归下降式调用writeTo，将value通过writer写入os
+    }
+    finishMessage(os, type, compressThreshold);
+}
+
+void mudong::rpc::encodeValue(std::string& output, Codec codec, const mudong::json::Value& value) {
+    if (codec == Codec::MSGPACK) {
+        MsgPackWriter writer(output);
+        value.writeTo(writer);
+    }
+    else {
+        StringAppendStream os(output);
+        mudong::json::Writer writer(os);
+        value.writeTo(writer);
+    }
+}
+
+void mudong::rpc::encodeResultMessage(std::string& output, FrameType type, Codec codec, const mudong::json::Value& id,
+                                      std::string_view result, uint8_t flags, size_t compressThreshold)
+{
+    assert(type == FrameType::BINARY || codec == Codec::JSON);
+
+    FrameWriteStream os(output, type, codec, flags);
+    if (codec == Codec::MSGPACK) {
+        MsgPackWriter writer(output);
+        writer.StartObject();
+        writer.Key("jsonrpc");
+        writer.String("2.0");
+        writer.Key("id");
+        id.writeTo(writer);
+        writer.Key("result");
+        writer.Raw(result);
+        writer.EndObject();
+    }
+    else {
+        // json的Writer没有写入原始文本的接口，外层的object直接拼接
+        os.put(R"({"jsonrpc":"2.0","id":)");
+        mudong::json::Writer writer(os);
+        id.writeTo(writer);
+        os.put(R"(,"result":)");
+        os.put(result);
+        os.put('}');
+    }
+    finishMessage(os, type, compressThreshold);
+}
+
+const char* mudong::rpc::decodeMessage(const FrameHeader& frame, std::string_view body, size_t maxBodyLen, mudong::json::Value& value) {
+    std::string raw;
+    if (frame.flags & kFrameCompressed) {
+        auto err = decompressBody(body, maxBodyLen, raw);
+        if (err != nullptr) {
+            return err;
+        }
+        body = raw;
+    }
+
+    if (frame.codec == Codec::MSGPACK) {
+        auto err = parseMsgPack(body.data(), body.length(), value);
+        return err == MsgPackError::OK ? nullptr : msgPackErrorStr(err);
+    }
+
+    mudong::json::Document document;
+    auto err = document.parse(body.data(), body.length());
+    if (err != mudong::json::ParseError::PARSE_OK) {
+        return mudong::json::parseErrorStr(err);
+    }
+    value = document; // Document is a Value，共享同一份数据
+    return nullptr;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include <mudong-json/include/Value.hpp>
+
+#include "codec/Frame.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+constexpr size_t kNoCompression = std::numeric_limits<size_t>::max();
+
+// 将value按codec序列化为一个完整的帧，追加到output末尾；body直接写入帧内存，不产生中间副本
+// 二进制帧的body不小于compressThreshold时尝试压缩，压缩后没有变小则原样发送；flags原样写入header
+void encodeMessage(std::string& output, FrameType type, Codec codec, const json::Value& value,
+                   uint8_t flags = 0, size_t compressThreshold = kNoCompression);
+
+// 只将value按codec序列化后追加到output末尾，不带帧header，结果可供encodeResultMessage多次使用
+void encodeValue(std::string& output, Codec codec, const json::Value& value);
+
+// 以预先按codec序列化好的result拼装一个成功响应的帧，成员与UserDoneCallback构造的响应相同，只有id需要序列化
+void encodeResultMessage(std::string& output, FrameType type, Codec codec, const json::Value& id, std::string_view result,
+                         uint8_t flags = 0, size_t compressThreshold = kNoCompression);
+
+// 按帧header中的codec和flags反序列化body，压缩的body解压后不能超过maxBodyLen；成功返回nullptr，失败返回错误描述
+const char* decodeMessage(const FrameHeader& frame, std::string_view body, size_t maxBodyLen, json::Value& value);
+
+} // namespace rpc
+
+} // namespace mudong
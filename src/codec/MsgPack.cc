@@ -0,0 +1,377 @@
+#include <bit>
+#include <cassert>
+#include <limits>
+
+#include "codec/MsgPack.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const int kMaxDepth = 512; // 嵌套层数上限，防止恶意输入耗尽栈空间
+
+template<typename T>
+T readBigEndian(const unsigned char* p) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value = static_cast<T>((value << 8) | p[i]);
+    }
+    return value;
+}
+
+class MsgPackReader {
+
+public:
+    MsgPackReader(const char* data, size_t len)
+            : cur_(reinterpret_cast<const unsigned char*>(data)),
+              end_(cur_ + len)
+    {}
+
+    MsgPackError parse(mudong::json::Value& value) {
+        auto err = parseValue(value, 0);
+        if (err == MsgPackError::OK && cur_ != end_) {
+            return MsgPackError::TRAILING;
+        }
+        return err;
+    }
+
+private:
+    size_t remain() const {
+        return static_cast<size_t>(end_ - cur_);
+    }
+
+    template<typename T>
+    bool read(T& value) {
+        if (remain() < sizeof(T)) return false;
+        value = readBigEndian<T>(cur_);
+        cur_ += sizeof(T);
+        return true;
+    }
+
+    MsgPackError parseValue(mudong::json::Value& value, int depth) {
+        if (depth > kMaxDepth) return MsgPackError::TOO_DEEP;
+        if (remain() == 0) return MsgPackError::TRUNCATED;
+
+        uint8_t code = *cur_++;
+        if (code <= 0x7f) { // positive fixint
+            value = mudong::json::Value(static_cast<int32_t>(code));
+            return MsgPackError::OK;
+        }
+        if (code >= 0xe0) { // negative fixint
+            value = mudong::json::Value(static_cast<int32_t>(static_cast<int8_t>(code)));
+            return MsgPackError::OK;
+        }
+        if ((code & 0xe0) == 0xa0) return parseString(value, code & 0x1f);
+        if ((code & 0xf0) == 0x90) return parseArray(value, code & 0x0f, depth);
+        if ((code & 0xf0) == 0x80) return parseMap(value, code & 0x0f, depth);
+
+        switch (code) {
+            case 0xc0:
+                value = mudong::json::Value(mudong::json::ValueType::TYPE_NULL);
+                return MsgPackError::OK;
+            case 0xc2:
+            case 0xc3:
+                value = mudong::json::Value(code == 0xc3);
+                return MsgPackError::OK;
+            case 0xca: {
+                uint32_t bits;
+                if (!read(bits)) return MsgPackError::TRUNCATED;
+                value = mudong::json::Value(static_cast<double>(std::bit_cast<float>(bits)));
+                return MsgPackError::OK;
+            }
+            case 0xcb: {
+                uint64_t bits;
+                if (!read(bits)) return MsgPackError::TRUNCATED;
+                value = mudong::json::Value(std::bit_cast<double>(bits));
+                return MsgPackError::OK;
+            }
+            case 0xcc: return parseUnsigned<uint8_t>(value);
+            case 0xcd: return parseUnsigned<uint16_t>(value);
+            case 0xce: return parseUnsigned<uint32_t>(value);
+            case 0xcf: return parseUnsigned<uint64_t>(value);
+            case 0xd0: return parseSigned<uint8_t, int8_t>(value);
+            case 0xd1: return parseSigned<uint16_t, int16_t>(value);
+            case 0xd2: return parseSigned<uint32_t, int32_t>(value);
+            case 0xd3: return parseSigned<uint64_t, int64_t>(value);
+            case 0xc4: // bin按字符串处理
+            case 0xd9: return parseSized<uint8_t>(value, &MsgPackReader::parseString);
+            case 0xc5:
+            case 0xda: return parseSized<uint16_t>(value, &MsgPackReader::parseString);
+            case 0xc6:
+            case 0xdb: return parseSized<uint32_t>(value, &MsgPackReader::parseString);
+            case 0xdc: return parseSizedContainer<uint16_t>(value, &MsgPackReader::parseArray, depth);
+            case 0xdd: return parseSizedContainer<uint32_t>(value, &MsgPackReader::parseArray, depth);
+            case 0xde: return parseSizedContainer<uint16_t>(value, &MsgPackReader::parseMap, depth);
+            case 0xdf: return parseSizedContainer<uint32_t>(value, &MsgPackReader::parseMap, depth);
+            default:
+                return MsgPackError::BAD_TYPE; // ext等mudong::json::Value无法表示的类型
+        }
+    }
+
+    // 整数统一按json解析器的规则落到int32或int64
+    static mudong::json::Value makeInteger(int64_t i64) {
+        if (i64 >= std::numeric_limits<int32_t>::min() && i64 <= std::numeric_limits<int32_t>::max()) {
+            return mudong::json::Value(static_cast<int32_t>(i64));
+        }
+        return mudong::json::Value(i64);
+    }
+
+    template<typename U>
+    MsgPackError parseUnsigned(mudong::json::Value& value) {
+        U u;
+        if (!read(u)) return MsgPackError::TRUNCATED;
+        if (static_cast<uint64_t>(u) > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            return MsgPackError::BAD_TYPE;
+        }
+        value = makeInteger(static_cast<int64_t>(u));
+        return MsgPackError::OK;
+    }
+
+    template<typename U, typename S>
+    MsgPackError parseSigned(mudong::json::Value& value) {
+        U u;
+        if (!read(u)) return MsgPackError::TRUNCATED;
+        value = makeInteger(static_cast<S>(u));
+        return MsgPackError::OK;
+    }
+
+    template<typename U>
+    MsgPackError parseSized(mudong::json::Value& value, MsgPackError (MsgPackReader::*parser)(mudong::json::Value&, size_t)) {
+        U n;
+        if (!read(n)) return MsgPackError::TRUNCATED;
+        return (this->*parser)(value, n);
+    }
+
+    template<typename U>
+    MsgPackError parseSizedContainer(mudong::json::Value& value, MsgPackError (MsgPackReader::*parser)(mudong::json::Value&, size_t, int), int depth) {
+        U n;
+        if (!read(n)) return MsgPackError::TRUNCATED;
+        return (this->*parser)(value, n, depth);
+    }
+
+    MsgPackError parseString(mudong::json::Value& value, size_t n) {
+        if (remain() < n) return MsgPackError::TRUNCATED;
+        value = mudong::json::Value(std::string_view(reinterpret_cast<const char*>(cur_), n));
+        cur_ += n;
+        return MsgPackError::OK;
+    }
+
+    MsgPackError parseArray(mudong::json::Value& value, size_t n, int depth) {
+        if (remain() < n) return MsgPackError::TRUNCATED; // 每个元素至少占1字节，提前拦截伪造的超大长度
+        value = mudong::json::Value(mudong::json::ValueType::TYPE_ARRAY);
+        for (size_t i = 0; i < n; ++i) {
+            mudong::json::Value element;
+            auto err = parseValue(element, depth + 1);
+            if (err != MsgPackError::OK) return err;
+            value.addValue(std::move(element));
+        }
+        return MsgPackError::OK;
+    }
+
+    MsgPackError parseMap(mudong::json::Value& value, size_t n, int depth) {
+        if (remain() / 2 < n) return MsgPackError::TRUNCATED;
+        value = mudong::json::Value(mudong::json::ValueType::TYPE_OBJECT);
+        for (size_t i = 0; i < n; ++i) {
+            mudong::json::Value key;
+            auto err = parseValue(key, depth + 1);
+            if (err != MsgPackError::OK) return err;
+            if (!key.isString()) return MsgPackError::BAD_KEY; // json object的key只能是字符串
+
+            mudong::json::Value member;
+            err = parseValue(member, depth + 1);
+            if (err != MsgPackError::OK) return err;
+            value.addMember(std::move(key), std::move(member));
+        }
+        return MsgPackError::OK;
+    }
+
+    const unsigned char* cur_;
+    const unsigned char* end_;
+}; // class MsgPackReader
+
+} // anonymous namespace
+
+template<typename T>
+void MsgPackWriter::putBigEndian(T value) {
+    for (size_t i = sizeof(T); i > 0; --i) {
+        putByte(static_cast<uint8_t>(value >> ((i - 1) * 8)));
+    }
+}
+
+void MsgPackWriter::prefix() {
+    // object中的成员个数在Key处统计
+    if (!stack_.empty() && !stack_.back().inObject) {
+        ++stack_.back().count;
+    }
+}
+
+bool MsgPackWriter::Null() {
+    prefix();
+    putByte(0xc0);
+    return true;
+}
+
+bool MsgPackWriter::Bool(bool b) {
+    prefix();
+    putByte(b ? 0xc3 : 0xc2);
+    return true;
+}
+
+bool MsgPackWriter::Int32(int32_t i32) {
+    return Int64(i32);
+}
+
+// 整数按取值范围选择最短的编码
+bool MsgPackWriter::Int64(int64_t i64) {
+    prefix();
+    if (i64 >= 0) {
+        auto u = static_cast<uint64_t>(i64);
+        if (u <= 0x7f) {
+            putByte(static_cast<uint8_t>(u));
+        }
+        else if (u <= 0xff) {
+            putByte(0xcc);
+            putBigEndian(static_cast<uint8_t>(u));
+        }
+        else if (u <= 0xffff) {
+            putByte(0xcd);
+            putBigEndian(static_cast<uint16_t>(u));
+        }
+        else if (u <= 0xffffffff) {
+            putByte(0xce);
+            putBigEndian(static_cast<uint32_t>(u));
+        }
+        else {
+            putByte(0xcf);
+            putBigEndian(u);
+        }
+    }
+    else {
+        if (i64 >= -32) {
+            putByte(static_cast<uint8_t>(i64)); // negative fixint
+        }
+        else if (i64 >= std::numeric_limits<int8_t>::min()) {
+            putByte(0xd0);
+            putBigEndian(static_cast<uint8_t>(i64));
+        }
+        else if (i64 >= std::numeric_limits<int16_t>::min()) {
+            putByte(0xd1);
+            putBigEndian(static_cast<uint16_t>(i64));
+        }
+        else if (i64 >= std::numeric_limits<int32_t>::min()) {
+            putByte(0xd2);
+            putBigEndian(static_cast<uint32_t>(i64));
+        }
+        else {
+            putByte(0xd3);
+            putBigEndian(static_cast<uint64_t>(i64));
+        }
+    }
+    return true;
+}
+
+bool MsgPackWriter::Double(double d) {
+    prefix();
+    putByte(0xcb);
+    putBigEndian(std::bit_cast<uint64_t>(d));
+    return true;
+}
+
+bool MsgPackWriter::String(std::string_view s) {
+    prefix();
+    putString(s);
+    return true;
+}
+
+bool MsgPackWriter::Raw(std::string_view encoded) {
+    prefix();
+    output_.append(encoded);
+    return true;
+}
+
+void MsgPackWriter::putString(std::string_view s) {
+    size_t n = s.length();
+    if (n <= 31) {
+        putByte(static_cast<uint8_t>(0xa0 | n));
+    }
+    else if (n <= 0xff) {
+        putByte(0xd9);
+        putBigEndian(static_cast<uint8_t>(n));
+    }
+    else if (n <= 0xffff) {
+        putByte(0xda);
+        putBigEndian(static_cast<uint16_t>(n));
+    }
+    else {
+        putByte(0xdb);
+        putBigEndian(static_cast<uint32_t>(n));
+    }
+    output_.append(s);
+}
+
+bool MsgPackWriter::StartObject() {
+    prefix();
+    startContainer();
+    stack_.back().inObject = true;
+    return true;
+}
+
+bool MsgPackWriter::Key(std::string_view s) {
+    assert(!stack_.empty() && stack_.back().inObject);
+    ++stack_.back().count; // map header中记录的是kv对的个数
+    putString(s);
+    return true;
+}
+
+bool MsgPackWriter::EndObject() {
+    endContainer(0xdf);
+    return true;
+}
+
+bool MsgPackWriter::StartArray() {
+    prefix();
+    startContainer();
+    return true;
+}
+
+bool MsgPackWriter::EndArray() {
+    endContainer(0xdd);
+    return true;
+}
+
+void MsgPackWriter::startContainer() {
+    stack_.push_back(Level{output_.size(), 0, false});
+    output_.append(5, '\0'); // 1字节类型 + 4字节长度，End时回填
+}
+
+void MsgPackWriter::endContainer(uint8_t code32) {
+    assert(!stack_.empty());
+    Level level = stack_.back();
+    stack_.pop_back();
+
+    // 固定使用32位长度格式原地回填，不压缩为fix/16位，避免每次关闭容器都搬移其后的全部字节
+    char* header = output_.data() + level.headerPos;
+    uint32_t n = level.count;
+    header[0] = static_cast<char>(code32);
+    header[1] = static_cast<char>(n >> 24);
+    header[2] = static_cast<char>(n >> 16);
+    header[3] = static_cast<char>(n >> 8);
+    header[4] = static_cast<char>(n);
+}
+
+MsgPackError mudong::rpc::parseMsgPack(const char* data, size_t len, mudong::json::Value& value) {
+    MsgPackReader reader(data, len);
+    return reader.parse(value);
+}
+
+const char* mudong::rpc::msgPackErrorStr(MsgPackError err) {
+    switch (err) {
+        case MsgPackError::OK:        return "ok";
+        case MsgPackError::TRUNCATED: return "msgpack truncated";
+        case MsgPackError::BAD_TYPE:  return "msgpack type not supported";
+        case MsgPackError::BAD_KEY:   return "msgpack map key must be string";
+        case MsgPackError::TOO_DEEP:  return "msgpack nesting too deep";
+        case MsgPackError::TRAILING:  return "msgpack root not singular";
+    }
+    return "unknown msgpack error";
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mudong-json/include/Value.hpp>
+
+namespace mudong {
+
+namespace rpc {
+
+/* MessagePack编解码，与json共用同一套json::Value数据模型
+数值按二进制原样存放，省去了json中数字与文本之间的格式化和解析，适合以double和整型数组为主的负载
+
+编码端实现了与mudong::json::Writer相同的Handler接口，可直接通过Value::writeTo驱动；
+容器元素个数在End时才能确定，因此统一按32位长度格式预留header，结束时原地回填；
+每个容器多占至多4字节，换取编码过程中不搬移已写出的数据
+ */
+class MsgPackWriter {
+
+public:
+    explicit MsgPackWriter(std::string& output)
+            : output_(output)
+    {}
+    MsgPackWriter(const MsgPackWriter&) = delete;
+    MsgPackWriter& operator=(const MsgPackWriter&) = delete;
+
+    bool Null();
+    bool Bool(bool b);
+    bool Int32(int32_t i32);
+    bool Int64(int64_t i64);
+    bool Double(double d);
+    bool String(std::string_view s);
+    bool StartObject();
+    bool Key(std::string_view s);
+    bool EndObject();
+    bool StartArray();
+    bool EndArray();
+
+    // 写入一个已经编码好的值，encoded须为完整的MessagePack值
+    bool Raw(std::string_view encoded);
+
+private:
+    void prefix(); // 每写一个值之前调用，累加所在容器的元素个数
+    void startContainer();
+    void endContainer(uint8_t code32);
+    void putString(std::string_view s);
+
+    void putByte(uint8_t byte) {
+        output_.push_back(static_cast<char>(byte));
+    }
+
+    template<typename T>
+    void putBigEndian(T value);
+
+    struct Level {
+        size_t headerPos; // 容器header在output中的偏移
+        uint32_t count;   // 数组元素个数或object成员个数
+        bool inObject;
+    };
+
+    std::string& output_;
+    std::vector<Level> stack_;
+}; // class MsgPackWriter
+
+enum class MsgPackError {
+    OK,
+    TRUNCATED,
+    BAD_TYPE,
+    BAD_KEY,
+    TOO_DEEP,
+    TRAILING,
+};
+
+MsgPackError parseMsgPack(const char* data, size_t len, json::Value& value);
+
+const char* msgPackErrorStr(MsgPackError err);
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include <mudong-json/include/Value.hpp>
+
+#include "utils/util.hpp"
+#include "utils/Exception.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 协程风格handler和client调用的返回类型，由mudong-rpc-stub -r生成的stub使用
+Task是惰性的，被co_await时才开始执行，执行完毕后通过对称转移直接恢复等待它的协程，不经过任何调度器，
+因此协程始终运行在恢复它的线程上：handler在IO线程或线程池中开始执行，等待client调用时在client的IO线程中恢复。
+协程帧只在创建时分配一次，取代回调风格中为串联多个调用而在堆上拼装的状态
+ */
+namespace detail {
+
+template<typename T>
+struct TaskPromise;
+
+} // namespace detail
+
+template<typename T = void>
+class Task : noncopyable {
+
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task(Task&& rhs) noexcept
+            : handle_(std::exchange(rhs.handle_, nullptr))
+    {}
+
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+
+    // 记下等待者后转移到Task自己的协程开始执行
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle_.promise().continuation = continuation;
+        return handle_;
+    }
+
+    T await_resume() {
+        auto& promise = handle_.promise();
+        if (promise.exception) {
+            std::rethrow_exception(promise.exception);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*promise.value);
+        }
+    }
+
+private:
+    friend promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+            : handle_(handle)
+    {}
+
+    std::coroutine_handle<promise_type> handle_;
+}; // class Task
+
+namespace detail {
+
+struct TaskPromiseBase {
+
+    // 执行完毕时恢复等待者，没有等待者时停在final suspend点，由Task析构时销毁
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        exception = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation; // co_await该Task的协程
+    std::exception_ptr exception;
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object() noexcept {
+        return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+    }
+
+    void return_value(T v) {
+        value.emplace(std::move(v));
+    }
+
+    std::optional<T> value;
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept {
+        return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+    }
+
+    void return_void() const noexcept {}
+};
+
+} // namespace detail
+
+namespace detail {
+
+// 立即开始执行、执行完毕后自行销毁的协程，用于在回调风格的框架中启动一个Task
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+
+        void return_void() const noexcept {}
+
+        // spawn中已处理了协议相关的异常，其余异常与回调风格中一样视为handler的bug
+        void unhandled_exception() const noexcept {
+            std::terminate();
+        }
+    };
+};
+
+} // namespace detail
+
+// 在当前线程中立即开始执行handler，直到第一次挂起；完成后以结果回复，抛出的RequestException以error response回复
+inline detail::Detached spawn(Task<json::Value> task, UserDoneCallback done) {
+    try {
+        done(co_await std::move(task));
+    }
+    catch (RequestException& e) {
+        done.error(e.err(), e.detail());
+    }
+}
+
+// notify没有响应，失败只记录日志
+inline detail::Detached spawn(Task<void> task) {
+    try {
+        co_await std::move(task);
+    }
+    catch (NotifyException& e) {
+        WARN("notify error, code:{}, message:{}, data:{}", e.err().asCode(), e.err().asString(), e.detail());
+    }
+}
+
+} // namespace rpc
+
+} // namespace mudong
@@ -1,8 +1,11 @@
-#include <mudong-json/include/Document.hpp>
-#include <mudong-json/include/Writer.hpp>
-#include <mudong-json/include/StringWriteStream.hpp>
+#include <algorithm>
+#include <any>
+
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "utils/Exception.hpp"
+#include "codec/Message.hpp"
 #include "server/BaseServer.hpp"
 #include "server/RpcServer.hpp"
 
@@ -12,6 +15,31 @@ namespace {
 
 const size_t kHighWaterMark = 65536;
 const size_t kMaxMessageLen = 100 * 1024 * 1024;
+const size_t kDefaultMessageBudget = 64;
+const size_t kDefaultUploadWindow = 1024 * 1024;
+const size_t kMaxUploadsPerSession = 16;  // 单个连接同时进行的上传数上限，缓存的上传数据不超过上限乘以接收窗口
+const size_t kMaxTopicsPerSession = 256; // 单个连接订阅的topic数上限，订阅表的内存不由client无限制地增长
+
+ShmTransportPtr getShmTransport(const TcpConnectionPtr& conn) {
+    auto shm = std::any_cast<ShmTransportPtr>(&conn->getContext());
+    return shm != nullptr ? *shm : nullptr;
+}
+
+// 请求的done及其所有拷贝都析构时调用callback，无论请求是否产生响应（如notify），都能据此得知请求已处理完毕
+class InFlightGuard : noncopyable {
+
+public:
+    explicit InFlightGuard(std::function<void()> callback)
+            : callback_(std::move(callback))
+    {}
+
+    ~InFlightGuard() {
+        callback_();
+    }
+
+private:
+    std::function<void()> callback_;
+}; // class InFlightGuard
 
 } // anonymous namespace
 
@@ -19,33 +47,194 @@ template class BaseServer<RpcServer>;
 
 template<typename ProtocolServer>
 BaseServer<ProtocolServer>::BaseServer(EventLoop* loop, const InetAddress& listen)
-        : server_(loop, listen)
+        : loop_(loop),
+          tcpAddress_(listen),
+          listenTcp_(true),
+          numThread_(1),
+          coalescing_{kHighWaterMark, std::chrono::nanoseconds::zero()},
+          compressThreshold_(kNoCompression),
+          maxInFlightPerConnection_(0),
+          messageBudget_(kDefaultMessageBudget),
+          uploadWindow_(kDefaultUploadWindow),
+          inFlight_(0),
+          draining_(false),
+          drainTimer_(nullptr),
+          closingConnections_(false),
+          drained_(false)
+{}
+
+template<typename ProtocolServer>
+BaseServer<ProtocolServer>::BaseServer(EventLoop* loop, const UnixAddress& listen)
+        : loop_(loop),
+          listenTcp_(false),
+          numThread_(1),
+          coalescing_{kHighWaterMark, std::chrono::nanoseconds::zero()},
+          compressThreshold_(kNoCompression),
+          maxInFlightPerConnection_(0),
+          messageBudget_(kDefaultMessageBudget),
+          uploadWindow_(kDefaultUploadWindow),
+          inFlight_(0),
+          draining_(false),
+          drainTimer_(nullptr),
+          closingConnections_(false),
+          drained_(false)
 {
-    server_.setConnectionCallback(std::bind(&BaseServer::onConnection, this, _1));
-    server_.setMessageCallback(std::bind(&BaseServer::onMessage, this, _1, _2));
+    this->listen(listen);
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::setReusePort(bool on) {
+    assert(listenTcp_);
+    assert(tcpServer_ == nullptr && "setReusePort must be called before start");
+    if (on && reusePortServer_ == nullptr) {
+        // ReusePortServer在start时才bind，继承来的监听socket可以在此之前交给它
+        reusePortServer_ = std::make_unique<ReusePortServer>(loop_, tcpAddress_);
+        reusePortServer_->setNumThread(numThread_);
+        reusePortServer_->setConnectionCallback(std::bind(&BaseServer::onConnection, this, _1));
+    }
+    else if (!on) {
+        reusePortServer_.reset();
+    }
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::createTcpServer() {
+    if (!listenTcp_ || tcpServer_ != nullptr || reusePortServer_ != nullptr) {
+        return;
+    }
+    tcpServer_ = std::make_unique<TcpServer>(loop_, tcpAddress_);
+    tcpServer_->setNumThread(numThread_);
+    // message callback在onConnection中按连接绑定，见onConnection
+    tcpServer_->setConnectionCallback(std::bind(&BaseServer::onConnection, this, _1));
+}
+
+template<typename ProtocolServer>
+bool BaseServer<ProtocolServer>::inheritListeners(const UnixAddress& address) {
+    // 本进程的交接地址此时还未bind，否则会连到自己
+    assert(handoffServer_ == nullptr);
+    auto fds = ListenerHandoff::receive(address);
+    if (fds.empty()) {
+        return false;
+    }
+    setReusePort(true);
+    reusePortServer_->adoptListeners(std::move(fds));
+    return true;
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::listenHandoff(const UnixAddress& address, std::chrono::milliseconds drainTimeout, std::function<void()> onDrained) {
+    assert(reusePortServer_ != nullptr && "listener handoff requires setReusePort(true)");
+    assert(handoffServer_ == nullptr);
+    handoffServer_ = std::make_unique<UnixServer>(loop_, address);
+    // 交接在握手阶段完成，连接本身随即关闭；握手在loop_所在线程中执行，此时可以读取监听socket
+    handoffServer_->setHandshakeCallback([this, drainTimeout, onDrained = std::move(onDrained)](EventLoop*, int connfd) -> std::any {
+        if (draining_) {
+            return std::any(); // 已经交接过或正在退出
+        }
+        // 抽象地址不受文件权限保护，只把监听socket交给同一用户的进程，否则任何本地用户都能夺走端口并让本进程退出
+        struct ucred cred = {};
+        socklen_t len = sizeof(cred);
+        if (::getsockopt(connfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 || cred.uid != ::geteuid()) {
+            WARN("BaseServer::listenHandoff() refuse handoff to pid {} uid {}", cred.pid, cred.uid);
+            return std::any();
+        }
+        if (ListenerHandoff::send(connfd, reusePortServer_->listenFds())) {
+            INFO("BaseServer::listenHandoff() listeners handed off, start draining");
+            drain(drainTimeout, onDrained);
+        }
+        return std::any();
+    });
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::listen(const UnixAddress& local) {
+    auto server = std::make_unique<UnixServer>(loop_, local);
+    server->setNumThread(numThread_);
+    server->setConnectionCallback(std::bind(&BaseServer::onConnection, this, _1));
+    unixServers_.push_back(std::move(server));
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::listenShm(const UnixAddress& local) {
+    listen(local);
+    unixServers_.back()->setHandshakeCallback([](EventLoop* loop, int connfd) -> std::any {
+        auto shm = ShmTransport::accept(loop, connfd);
+        return shm != nullptr ? std::any(shm) : std::any();
+    }, true);
 }
 
 template<typename ProtocolServer>
 void BaseServer<ProtocolServer>::onConnection(const TcpConnectionPtr& conn) {
     if (conn->connected()) {
         DEBUG("connection {} is [up]", conn->peer().toIpPort());
-        conn->setHighWaterMarkCallback(std::bind(&BaseServer::onHighWaterMark, this, _1, _2), kHighWaterMark);
+        auto shm = getShmTransport(conn);
+        // 连接建立时创建Session并绑定到该连接的message callback上，此时连接尚未开始处理读事件
+        auto session = std::make_shared<Session>(conn, coalescing_);
+        conn->setMessageCallback(std::bind(&BaseServer::onMessage, this, session, _1, _2));
+        conn->setHighWaterMarkCallback(std::bind(&BaseServer::onHighWaterMark, this, session, _1, _2), kHighWaterMark);
+
+        // 共享内存连接的请求从shm中读出，交给同样的拆包逻辑
+        if (shm != nullptr) {
+            session->setShmTransport(shm);
+            shm->setMessageCallback([this, session, conn](Buffer& buffer) {
+                onMessage(session, conn, buffer);
+            });
+            // 响应写入共享内存而不是socket，输出的高水位要看shm中暂存的数据，与TCP一样暂停读并停止流式输出和推送
+            shm->setHighWaterMarkCallback([session, conn](size_t mark) {
+                DEBUG("connection {} shm high watermark {}", conn->peer().toIpPort(), mark);
+                session->blockRead(kBlockedByOutput);
+                session->setOutputBlocked(true);
+            }, kHighWaterMark);
+            shm->setWriteCompleteCallback([session]() {
+                session->unblockRead(kBlockedByOutput);
+                session->setOutputBlocked(false);
+            });
+            shm->start();
+        }
+        // 握手得到的shm已经交给Session，之后context改为保存Session，断开时据此清理
+        conn->setContext(session);
+        {
+            std::lock_guard lock(mutex_);
+            connections_.insert(conn);
+        }
+        // TcpServer没有停止accept的接口，drain开始之后建立的连接在这里直接通知并关闭
+        if (draining_) {
+            closeConnection(conn, false);
+        }
     }
     else {
         DEBUG("connection {} is [down]", conn->peer().toIpPort());
+        auto session = std::any_cast<SessionPtr>(&conn->getContext());
+        if (session != nullptr) {
+            for (auto& topic : (*session)->topics()) {
+                pubsub_.unsubscribe(topic, session->get());
+            }
+            (*session)->close();
+        }
+        bool empty;
+        {
+            std::lock_guard lock(mutex_);
+            connections_.erase(conn);
+            empty = connections_.empty();
+        }
+        if (draining_ && empty) {
+            loop_->queueInLoop(std::bind(&BaseServer::checkDrained, this));
+        }
     }
 }
 
 template<typename ProtocolServer>
-void BaseServer<ProtocolServer>::onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
+void BaseServer<ProtocolServer>::onMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer) {
+    FrameHeader frame{FrameType::TEXT, 0, Codec::JSON, 0, 0}; // 记录最近一个帧的header，出错时按同样的帧类型和编码回复
     // 尝试处理message
     try {
-        handleMessage(conn, buffer);
+        handleMessage(session, conn, buffer, frame);
     }
     // 失败则返回异常信息打包成Value发送给对方，并断开连接
     catch (RequestException& e) {
         mudong::json::Value response = wrapException(e);
-        sendResponse(conn, response);
+        sendResponse(session, frame.type, frame.codec, response);
+        session->flush(); // shutdown之后的send会被丢弃，因此先把已合并的响应全部发出
         conn->shutdown();
 
         WARN("BaseServer::onMessage() {} request error: {}", conn->peer().toIpPort(), e.what());
@@ -53,61 +242,457 @@ void BaseServer<ProtocolServer>::onMessage(const TcpConnectionPtr& conn, Buffer&
 }
 
 template<typename ProtocolServer>
-void BaseServer<ProtocolServer>::onHighWaterMark(const TcpConnectionPtr& conn, size_t mark) {
+void BaseServer<ProtocolServer>::onHighWaterMark(const SessionPtr& session, const TcpConnectionPtr& conn, size_t mark) {
     DEBUG("connection {} high watermark {}", conn->peer().toIpPort(), mark);
 
-    conn->setWriteCompleteCallback(std::bind(&BaseServer::onWriteComplete, this, _1));
-    conn->stopRead();
+    conn->setWriteCompleteCallback(std::bind(&BaseServer::onWriteComplete, this, session, _1));
+    session->blockRead(kBlockedByOutput);
+    session->setOutputBlocked(true);
 }
 
 template<typename ProtocolServer>
-void BaseServer<ProtocolServer>::onWriteComplete(const TcpConnectionPtr& conn) {
+void BaseServer<ProtocolServer>::onWriteComplete(const SessionPtr& session, const TcpConnectionPtr& conn) {
     DEBUG("connection {} write complete", conn->peer().toIpPort());
-    conn->startRead();
+    session->unblockRead(kBlockedByOutput);
+    session->setOutputBlocked(false);
 }
 
+// 可能在worker线程中调用
 template<typename ProtocolServer>
-void BaseServer<ProtocolServer>::handleMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
-    // 消息体格式可参看sendResponse代码，按约定好的格式进行解析
-    while (true) {
-        const char* crlf = buffer.findCRLF(); // 找到下一个回车换行
-        if (crlf == nullptr) break; // 无了，就跳出循环
-        if (crlf == buffer.peek()) {
+void BaseServer<ProtocolServer>::onRequestDone(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer* buffer) {
+    // 从上限降下来时才需要恢复；总是投递到IO线程，避免在handleMessage中同步完成的请求导致重入
+    if (session->removeInFlight() + 1 == maxInFlightPerConnection_) {
+        conn->getLoop()->queueInLoop([this, session, conn, buffer]() {
+            if (session->inFlight() < maxInFlightPerConnection_ && session->readBlocked(kBlockedByInFlight)) {
+                session->unblockRead(kBlockedByInFlight);
+                resumeMessage(session, conn, buffer);
+            }
+        });
+    }
+}
+
+// 继续处理buffer中已经收到、因上限或预算而暂缓处理的请求，读事件不会再为这些数据触发
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::resumeMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer* buffer) {
+    if (conn->connected() && buffer->readableBytes() > 0) {
+        onMessage(session, conn, *buffer);
+    }
+}
+
+// 本次读到的BULK请求推迟到INTERACTIVE请求都分发之后再分发，延迟等级由子类的requestPriority给出
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::handleMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer, FrameHeader& frame) {
+    std::vector<DeferredRequest> deferred;
+    try {
+        readRequests(session, conn, buffer, frame, deferred);
+    }
+    catch (RequestException&) {
+        // 出错之前已经解析出的请求照常处理
+        dispatchDeferred(deferred);
+        throw;
+    }
+    dispatchDeferred(deferred);
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::dispatchDeferred(std::vector<DeferredRequest>& deferred) {
+    for (auto& [request, done, flow, upload, loop] : deferred) {
+        convert().handleRequest(request, done, flow, upload, loop);
+    }
+}
+
+// 客户端流式上传的后续消息，交给打开调用时创建的StreamReader；调用已经回复或id未知时直接丢弃
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::handleUploadMessage(const SessionPtr& session, mudong::json::Value& message, size_t bytes) {
+    auto id = message.findMember("id");
+    auto version = message.findMember("jsonrpc");
+    if (id == message.endMember() || !(id->value.isInt32() || id->value.isInt64()) ||
+        version == message.endMember() || !version->value.isString() || version->value.getStringView() != "2.0" ||
+        message.getSize() != 3) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "bad upload message");
+    }
+
+    auto reader = session->findUpload(id->value.isInt32() ? id->value.getInt32() : id->value.getInt64());
+    if (reader == nullptr) {
+        TRACE("BaseServer::handleUploadMessage() discard message of closed upload");
+        return;
+    }
+    auto chunk = message.findMember("stream");
+    if (chunk != message.endMember()) {
+        reader->push(chunk->value, bytes);
+    }
+    else {
+        reader->finish();
+        session->removeUpload(reader->id(), reader.get());
+    }
+}
+
+/* 打开上传调用时立即登记，后续消息可能就在同一次读到的数据中；只接受整数id，与client生成的id一致。
+id与进行中的上传重复或同时进行的上传过多时以错误回复这一个调用，返回false，连接和其他上传不受影响
+ */
+template<typename ProtocolServer>
+bool BaseServer<ProtocolServer>::openUpload(const SessionPtr& session, const FrameHeader& frame, mudong::json::Value& request, StreamReaderPtr& upload) {
+    if (!convert().isUploadRequest(request)) {
+        return true;
+    }
+    auto id = request.findMember("id");
+    if (id == request.endMember() || !(id->value.isInt32() || id->value.isInt64())) {
+        return true; // 交给handleRequest以错误回复
+    }
+    int64_t uploadId = id->value.isInt32() ? id->value.getInt32() : id->value.getInt64();
+    const char* error = nullptr;
+    if (session->findUpload(uploadId) != nullptr) {
+        error = "duplicate upload id";
+    }
+    else if (session->numUploads() >= kMaxUploadsPerSession) {
+        error = "too many concurrent uploads";
+    }
+    if (error != nullptr) {
+        auto response = errorResponse(id->value, RpcError(ERROR::RPC_INVALID_REQUEST), error);
+        sendResponse(session, frame.type, frame.codec, response);
+        return false;
+    }
+    upload = std::make_shared<StreamReader>(session, uploadId, uploadWindow_);
+    session->addUpload(upload);
+    return true;
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::readRequests(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer, FrameHeader& frame,
+                                              std::vector<DeferredRequest>& deferred) {
+    // 消息体格式可参看codec/Frame.hpp，文本帧和二进制帧逐帧自动识别，同一连接上可以混用
+    for (size_t handled = 0; ; ++handled) {
+        // 达到上限时剩余的请求留在buffer中，等有请求完成后由onRequestDone继续处理
+        if (session->readBlocked(kBlockedByInFlight)) break;
+
+        if (messageBudget_ > 0 && handled == messageBudget_) {
+            if (buffer.readableBytes() > 0 && !session->resumeScheduled()) {
+                session->setResumeScheduled(true);
+                conn->getLoop()->queueInLoop([this, session, conn, buffer = &buffer]() {
+                    session->setResumeScheduled(false);
+                    resumeMessage(session, conn, buffer);
+                });
+            }
+            break;
+        }
+
+        auto err = decodeFrameHeader(buffer.peek(), buffer.readableBytes(), kMaxMessageLen, frame);
+        if (err == FrameError::INCOMPLETE) break; // header还没收全，等下一次onMessage
+
+        if (err == FrameError::EMPTY_HEADER) {
             buffer.retrieve(2);
             break;
         }
+        if (err != FrameError::OK) {
+            frame.codec = Codec::JSON; // header非法时codec字段不可信，回退为json
+            throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), frameErrorStr(err));
+        }
+
+        if (buffer.readableBytes() < frame.headerLen + frame.bodyLen) break; // 校验完整性
 
-        size_t headerLen = crlf - buffer.peek() + 2; // +2为包含了crlf的长度
+        if (frame.flags & kFrameAcceptCompression) {
+            session->setPeerAcceptsCompression();
+        }
 
-        mudong::json::Document header;
-        auto err = header.parse(buffer.peek(), headerLen); // Doc风格解析
-        // 必须是一个int32的正数
-        if (err != mudong::json::ParseError::PARSE_OK || !header.isInt32() || header.getInt32() <= 0) {
-            throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "invalid message length");
+        // body直接在buffer的可读区域上原地解析，不再拷贝成string；解析出的DOM自己持有数据，之后即可释放这段内存
+        mudong::json::Value request;
+        auto parseErr = decodeMessage(frame, std::string_view(buffer.peek() + frame.headerLen, frame.bodyLen), kMaxMessageLen, request);
+        buffer.retrieve(frame.headerLen + frame.bodyLen); // 出错的帧同样要丢弃，避免之后被重复处理
+        if (parseErr != nullptr) {
+            throw RequestException(RpcError(ERROR::RPC_PARSE_ERROR), parseErr);
         }
 
-        auto jsonLen = static_cast<uint32_t>(header.getInt32());
-        if (jsonLen > kMaxMessageLen) {
-            throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "message is too long");
+        if (isUploadMessage(request)) {
+            handleUploadMessage(session, request, frame.headerLen + frame.bodyLen);
+            continue;
+        }
+        if (draining_) {
+            rejectDraining(session, frame, request);
+            continue;
+        }
+        if (handleSubscription(session, frame, request)) {
+            continue;
         }
 
-        if (buffer.readableBytes() < headerLen + jsonLen) break; // 校验完整性
+        // 命中缓存时直接以预先序列化的result回复，不经过handler和Writer，也不计入正在处理的请求数
+        if (auto cached = convert().findCachedResult(request)) {
+            sendCachedResponse(session, frame.type, frame.codec, request["id"], *cached);
+            continue;
+        }
+
+        StreamReaderPtr upload;
+        if (!openUpload(session, frame, request, upload)) {
+            continue;
+        }
+
+        // done的所有拷贝析构时请求即处理完毕，drain据此等待在线程池中排队和执行的请求。
+        // 上传调用要等后续消息读进来才能完成，不计入单连接的上限，否则上限较小时会与暂停读互相等待；它的内存由接收窗口限制
+        bool limited = maxInFlightPerConnection_ > 0 && upload == nullptr;
+        if (limited && session->addInFlight() >= maxInFlightPerConnection_) {
+            session->blockRead(kBlockedByInFlight);
+        }
+        inFlight_.fetch_add(1);
+        auto guard = std::make_shared<InFlightGuard>([this, session, conn, buffer = &buffer, limited]() {
+            if (limited) onRequestDone(session, conn, buffer);
+            onRequestFinished();
+        });
 
-        buffer.retrieve(headerLen); // 认为header没问题，已解析完故丢弃
-        auto json = buffer.retrieveAsString(jsonLen); // 提取buffer中json部分
-        // 调用子类类型对象中的handleRequest，CRTP
-        convert().handleRequest(json, [conn, this](const mudong::json::Value& response){
+        // response使用与request相同的帧类型和编码
+        RpcDoneCallback done = [session, conn, this, type = frame.type, codec = frame.codec, guard, upload](const mudong::json::Value& response){
+            if (upload != nullptr && !isStreamChunk(response)) {
+                upload->close(); // 调用已经回复，之后到达的上传数据直接丢弃
+            }
             if (!response.isNull()) {
-                sendResponse(conn, response);
+                sendResponse(session, type, codec, response);
                 TRACE("BaseServer::handleMessage() {} request success", conn->peer().toIpPort());
             }
             else {
                 TRACE("BaseServer::handleMessage() {} notify sucess", conn->peer().toIpPort()); // notify是没有response的，按协议无需发送应答给客户端
             }
+        };
+
+        if (convert().requestPriority(request) == Priority::BULK) {
+            deferred.push_back(DeferredRequest{std::move(request), std::move(done), session, std::move(upload), conn->getLoop()});
+            continue;
+        }
+        // 调用子类类型对象中的handleRequest，CRTP；流式响应以session做流量控制
+        convert().handleRequest(request, done, session, upload, conn->getLoop());
+    }
+}
+
+/* 订阅是连接级别的状态，需要知道连接和它使用的帧类型、编码，因此在连接层处理，不经过RpcServer；
+不是rpc.subscribe/rpc.unsubscribe时返回false。参数不合法时与其他请求一样抛出异常
+ */
+template<typename ProtocolServer>
+bool BaseServer<ProtocolServer>::handleSubscription(const SessionPtr& session, const FrameHeader& frame, mudong::json::Value& request) {
+    if (!request.isObject()) return false;
+    auto method = request.findMember("method");
+    if (method == request.endMember() || !method->value.isString()) return false;
+    auto name = method->value.getStringView();
+    bool subscribe = name == kSubscribeMethod;
+    if (!subscribe && name != kUnsubscribeMethod) return false;
+
+    auto id = request.findMember("id");
+    if (id == request.endMember() || !(id->value.isString() || id->value.isInt32() || id->value.isInt64())) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "subscription must be a request with id");
+    }
+    auto params = request.findMember("params");
+    const mudong::json::Value* topic = nullptr;
+    if (params != request.endMember()) {
+        if (params->value.isArray() && params->value.getSize() == 1) {
+            topic = &params->value[0];
+        }
+        else if (params->value.isObject() && params->value.getSize() == 1 && params->value.findMember("topic") != params->value.endMember()) {
+            topic = &params->value["topic"];
+        }
+    }
+    if (topic == nullptr || !topic->isString()) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_PARAMS), id->value, "expect topic string");
+    }
+
+    auto topicName = topic->getString();
+    if (subscribe) {
+        // 超过上限时只拒绝这一次订阅，连接和已有的订阅不受影响
+        if (session->topics().size() >= kMaxTopicsPerSession && !session->hasTopic(topicName)) {
+            auto response = errorResponse(id->value, RpcError(ERROR::RPC_INVALID_REQUEST), "too many subscriptions");
+            sendResponse(session, frame.type, frame.codec, response);
+            return true;
+        }
+        session->addTopic(topicName);
+        pubsub_.subscribe(topicName, session, frame.type, frame.codec);
+    }
+    else if (session->removeTopic(topicName)) {
+        pubsub_.unsubscribe(topicName, session.get());
+    }
+
+    mudong::json::Value response(mudong::json::ValueType::TYPE_OBJECT);
+    response.addMember("jsonrpc", "2.0");
+    response.addMember("result", true);
+    response.addMember("id", id->value);
+    sendResponse(session, frame.type, frame.codec, response);
+    return true;
+}
+
+// drain期间到达的请求不再执行，以SERVER_DRAINING回复，client可以立即改发给其他server；notify没有响应，直接丢弃
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::rejectDraining(const SessionPtr& session, const FrameHeader& frame, const mudong::json::Value& request) {
+    auto rejectOne = [](const mudong::json::Value& one, mudong::json::Value& response) {
+        if (!one.isObject()) return false;
+        auto id = one.findMember("id");
+        if (id == one.endMember()) return false;
+        response = errorResponse(id->value, RpcError(ERROR::RPC_SERVER_DRAINING), "server is draining");
+        return true;
+    };
+
+    if (request.isArray()) {
+        mudong::json::Value responses(mudong::json::ValueType::TYPE_ARRAY);
+        for (size_t i = 0; i < request.getSize(); ++i) {
+            mudong::json::Value response;
+            if (rejectOne(request[i], response)) responses.addValue(response);
+        }
+        if (responses.getSize() > 0) sendResponse(session, frame.type, frame.codec, responses);
+        return;
+    }
+    mudong::json::Value response;
+    if (rejectOne(request, response)) {
+        sendResponse(session, frame.type, frame.codec, response);
+    }
+}
+
+// 可能在worker线程中调用
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::onRequestFinished() {
+    if (inFlight_.fetch_sub(1) == 1 && draining_) {
+        loop_->queueInLoop(std::bind(&BaseServer::checkDrained, this));
+    }
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::drain(std::chrono::milliseconds timeout, std::function<void()> callback) {
+    loop_->runInLoop([this, timeout, callback = std::move(callback)]() {
+        if (draining_.exchange(true)) return;
+        INFO("BaseServer::drain() stop accepting, {} request(s) in flight", inFlight_.load());
+
+        drainCallback_ = callback;
+        if (reusePortServer_ != nullptr) reusePortServer_->stopAccept();
+        for (auto& server : unixServers_) server->stopAccept();
+        if (handoffServer_ != nullptr) handoffServer_->stopAccept();
+
+        drainTimer_ = loop_->runAfter(timeout, [this]() {
+            drainTimer_ = nullptr;
+            WARN("BaseServer::drain() timeout, {} request(s) still in flight", inFlight_.load());
+            closeConnections(true);
+            finishDrain();
         });
+        checkDrained();
+    });
+}
+
+// 请求全部完成后关闭连接，连接全部关闭后结束drain
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::checkDrained() {
+    loop_->assertInLoopThread();
+    if (!draining_ || drained_) return;
+
+    if (inFlight_ == 0) {
+        closeConnections(false);
+    }
+    if (!closingConnections_) return;
+    {
+        std::lock_guard lock(mutex_);
+        if (!connections_.empty()) return;
+    }
+    finishDrain();
+}
+
+// 先推送rpc.drain通知再关闭写端，client读完已发出的响应后即可改连其他server；force时直接断开
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::closeConnections(bool force) {
+    loop_->assertInLoopThread();
+    closingConnections_ = true;
+
+    std::vector<TcpConnectionPtr> connections;
+    {
+        std::lock_guard lock(mutex_);
+        connections.assign(connections_.begin(), connections_.end());
+    }
+    for (auto& conn : connections) {
+        closeConnection(conn, force);
     }
 }
 
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::closeConnection(const TcpConnectionPtr& conn, bool force) {
+    conn->getLoop()->runInLoop([this, conn, force]() {
+        if (force) {
+            conn->forceClose();
+            return;
+        }
+        // drain开始时该IO线程可能正在读入最后一批请求，它们计入inFlight_之后才会执行到这里；
+        // 这些请求完成时会再次调用checkDrained
+        if (inFlight_ > 0) return;
+
+        auto session = std::any_cast<SessionPtr>(&conn->getContext());
+        if (session == nullptr) return;
+        mudong::json::Value notice(mudong::json::ValueType::TYPE_OBJECT);
+        notice.addMember("jsonrpc", "2.0");
+        notice.addMember("method", kDrainNotice);
+        notice.addMember("params", mudong::json::ValueType::TYPE_OBJECT);
+        // 旧版本client也能解析文本帧和json
+        sendResponse(*session, FrameType::TEXT, Codec::JSON, notice);
+        (*session)->flush(); // shutdown之后的send会被丢弃
+        conn->shutdown();
+    });
+}
+
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::finishDrain() {
+    if (drained_) return;
+    drained_ = true;
+    if (drainTimer_ != nullptr) {
+        loop_->cancelTimer(drainTimer_);
+        drainTimer_ = nullptr;
+    }
+    INFO("BaseServer::drain() done");
+    if (drainCallback_) drainCallback_();
+}
+
+template<typename ProtocolServer>
+size_t BaseServer<ProtocolServer>::publish(const std::string& topic, const mudong::json::Value& params) {
+    auto subscribers = pubsub_.subscribers(topic);
+    if (subscribers == nullptr) {
+        return 0;
+    }
+
+    mudong::json::Value notify(mudong::json::ValueType::TYPE_OBJECT);
+    notify.addMember("jsonrpc", "2.0");
+    notify.addMember("method", topic);
+    notify.addMember("params", params);
+
+    // 帧类型、编码和是否可压缩只有少数几种组合，各序列化一次
+    struct Encoded {
+        FrameType type;
+        Codec codec;
+        size_t threshold;
+        std::string message;
+    };
+    std::vector<Encoded> encoded;
+
+    size_t n = 0;
+    size_t skipped = 0;   // 本次开始被跳过的订阅者
+    size_t recovered = 0; // 本次恢复推送的订阅者
+    for (auto& s : *subscribers) {
+        auto session = s.session.lock();
+        if (session == nullptr) continue;
+        // 订阅者读得比发布慢时输出缓冲已达高水位，继续推送只会无限堆积，跳过这条推送；之后缓冲排空时恢复
+        if (!session->writable()) {
+            if (session->setPublishSkipped(true)) ++skipped;
+            continue;
+        }
+        if (session->setPublishSkipped(false)) ++recovered;
+
+        auto threshold = compressThresholdFor(session);
+        auto it = std::find_if(encoded.begin(), encoded.end(), [&](const Encoded& e) {
+            return e.type == s.type && e.codec == s.codec && e.threshold == threshold;
+        });
+        if (it == encoded.end()) {
+            encoded.push_back(Encoded{s.type, s.codec, threshold, std::string()});
+            it = encoded.end() - 1;
+            encodeMessage(it->message, s.type, s.codec, notify, kFrameAcceptCompression, threshold);
+        }
+        session->send(std::string_view(it->message));
+        ++n;
+    }
+    // 只在订阅者进入/离开被跳过的状态时记录，慢订阅者存在期间不会每次发布都打日志
+    if (skipped > 0) {
+        WARN("BaseServer::publish() {} start skipping {} slow subscriber(s)", topic, skipped);
+    }
+    if (recovered > 0) {
+        INFO("BaseServer::publish() {} resume {} subscriber(s)", topic, recovered);
+    }
+    return n;
+}
+
 /* exception消息体结构
 {
     "jsonrpc":"2.0",
@@ -133,19 +718,22 @@ mudong::json::Value BaseServer<ProtocolServer>::wrapException(RequestException&
 }
 
 template<typename ProtocolServer>
-void BaseServer<ProtocolServer>::sendResponse(const TcpConnectionPtr& conn, const mudong::json::Value& response) {
-    mudong::json::StringWriteStream os;
-    mudong::json::Writer writer(os); // 由writer操作向输出流os写
-    response.writeTo(writer); // 函数内部递归下降式调用writeTo，将response通过writer写入os
-
-    auto message = std::to_string(os.getStringView().length() + 2).append("\r\n").append(os.getStringView()).append("\r\n");
-    /* message有header和body两部分组成
-    header: body的长度
-    body: response + crlf分隔符
+void BaseServer<ProtocolServer>::sendResponse(const SessionPtr& session, FrameType type, Codec codec, const mudong::json::Value& response) {
+    // response直接序列化进帧内存，header预留后回填，格式见codec/Frame.hpp
+    // 可能在worker线程中调用，交由session合并同一轮事件循环内的响应，一次send发出
+    // server总能解压请求，因此始终在帧中声明，由client自行决定是否压缩；client声明过能够解压时才压缩响应
+    std::string message;
+    encodeMessage(message, type, codec, response, kFrameAcceptCompression, compressThresholdFor(session));
+    session->send(std::move(message));
+}
 
-    内存分布：header + "\r\n" + body + "\r\n"
-    */
-   conn->send(message);
+// 只在IO线程中调用，帧的其余部分与sendResponse相同
+template<typename ProtocolServer>
+void BaseServer<ProtocolServer>::sendCachedResponse(const SessionPtr& session, FrameType type, Codec codec,
+                                                    const mudong::json::Value& id, const CachedResult& cached) {
+    std::string message;
+    encodeResultMessage(message, type, codec, id, cached.encodedAs(codec), kFrameAcceptCompression, compressThresholdFor(session));
+    session->send(std::move(message));
 }
 
 template<typename ProtocolServer>
@@ -1,9 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
 #include <mudong-json/include/Value.hpp>
 
 #include "utils/RpcError.hpp"
 #include "utils/util.hpp"
+#include "codec/Frame.hpp"
+#include "codec/Message.hpp"
+#include "server/Session.hpp"
+#include "server/ResponseCache.hpp"
+#include "server/StreamReader.hpp"
+#include "server/PubSub.hpp"
+#include "server/ListenerHandoff.hpp"
+#include "server/ReusePortServer.hpp"
+#include "server/UnixServer.hpp"
 
 namespace mudong {
 
@@ -16,28 +31,124 @@ template<typename ProtocolServer>
 class BaseServer : noncopyable {
 
 public:
+    /* 每个监听地址（TCP以及listen/listenShm添加的每个unix socket）各自启动一组n个IO线程，互不共享，
+    其中第一个都是loop所在线程，因此IO线程总数为 1 + 监听地址数 * (n - 1)；同时监听多个地址时应相应调小n
+     */
     void setNumThread(size_t n) {
-        server_.setNumThread(n);
+        if (tcpServer_ != nullptr) tcpServer_->setNumThread(n);
+        if (reusePortServer_ != nullptr) reusePortServer_->setNumThread(n);
+        for (auto& server : unixServers_) server->setNumThread(n);
+        numThread_ = n;
     }
 
+    /* TCP监听改为每个IO线程各自持有一个SO_REUSEPORT的监听socket，由内核分散accept，连接在accept它的线程中建立，
+    见server/ReusePortServer.hpp；需在start之前调用，只对构造时传入的TCP地址生效
+     */
+    void setReusePort(bool on);
+
+    // 在TCP之外同时监听一个unix socket，需在start之前调用；两种连接共用同一套帧处理和回调
+    void listen(const UnixAddress& local);
+
+    // 监听一个unix socket，在其上完成握手后改用共享内存传输，见shm/ShmTransport.hpp；需在start之前调用
+    void listenShm(const UnixAddress& local);
+
     void start() {
-        server_.start();
+        createTcpServer();
+        if (tcpServer_ != nullptr) tcpServer_->start();
+        if (reusePortServer_ != nullptr) reusePortServer_->start();
+        for (auto& server : unixServers_) server->start();
+        if (handoffServer_ != nullptr) handoffServer_->start();
+    }
+
+    /* 优雅退出，可在任意线程调用，只生效一次。停止accept新连接，之后到达的请求不再执行，以SERVER_DRAINING错误回复；
+    已经收到的请求（包括在线程池中排队的）全部完成后，向每个连接推送rpc.drain通知并关闭连接，
+    连接全部关闭后在loop所在线程中调用callback。超过timeout仍未完成时强制关闭剩余的连接并调用callback
+     */
+    void drain(std::chrono::milliseconds timeout, std::function<void()> callback);
+
+    /* 重启时交接TCP监听socket，只用于setReusePort模式，需在start之前调用。
+    新进程先调用inheritListeners：连接旧进程的交接地址并继承它的全部监听socket，没有旧进程时返回false，照常新建监听socket；
+    之后调用listenHandoff在同一地址上等待下一次重启：新进程连上后把监听socket交给它，然后以drainTimeout开始drain，
+    结束后调用onDrained。交接前后监听socket始终处于listen状态，重启期间的连接不会被拒绝
+     */
+    bool inheritListeners(const UnixAddress& address);
+    void listenHandoff(const UnixAddress& address, std::chrono::milliseconds drainTimeout, std::function<void()> onDrained);
+
+    // 同一连接上的多个响应合并发送，maxBytes为单次合并的上限，maxDelay为最长等待时间，默认在本轮事件循环末尾发送
+    void setWriteCoalescing(size_t maxBytes, std::chrono::nanoseconds maxDelay) {
+        coalescing_ = WriteCoalescing{maxBytes, maxDelay};
+    }
+
+    // 每个连接上同时处理的请求数上限，达到上限后暂停读该连接，有请求完成后恢复；默认为0表示不限制。
+    // 一个pipeline大量请求的连接不会无限制地向线程池堆积任务
+    void setMaxInFlightPerConnection(size_t n) {
+        maxInFlightPerConnection_ = n;
+    }
+
+    // 每次读事件中一个连接最多处理n个请求，剩余的请求排到本轮事件循环末尾继续处理，
+    // 同一IO线程上的其他连接因此不会被一个连接长时间占用；0表示不限制
+    void setMessageBudget(size_t n) {
+        messageBudget_ = n;
     }
 
+    // 每个客户端流式上传在服务端缓存的数据上限，超过时暂停读该连接，见server/StreamReader.hpp；默认1MB。
+    // 每个连接同时进行的上传数有上限，单个连接缓存的上传数据不超过该上限乘以窗口
+    void setUploadWindow(size_t bytes) {
+        uploadWindow_ = bytes;
+    }
+
+    // 响应body不小于threshold时压缩后发送，只对声明了能够解压的连接生效，默认不压缩
+    void setCompressThreshold(size_t threshold) {
+        compressThreshold_ = threshold;
+    }
+
+    /* 向订阅了topic的所有连接推送{"jsonrpc":"2.0","method":topic,"params":params}，返回推送的连接数。
+    可在任意线程调用；每种帧类型和编码只序列化一次，各连接与响应一样合并发送。
+    输出缓冲已达高水位的连接跳过本次推送，不计入返回值，慢订阅者占用的内存不会随发布无限增长
+     */
+    size_t publish(const std::string& topic, const mudong::json::Value& params);
+
 protected:
     // CRTP常用权限控制，参考std::enable_shared_from_this源码
     BaseServer(EventLoop* loop, const InetAddress& listen);
+    BaseServer(EventLoop* loop, const UnixAddress& listen); // 只监听unix socket，之后仍可继续添加
     ~BaseServer() = default;
 
 private:
     void onConnection(const TcpConnectionPtr& conn);
-    void onMessage(const TcpConnectionPtr& conn, Buffer& buffer);
-    void onHighWaterMark(const TcpConnectionPtr& conn, size_t mark);
-    void onWriteComplete(const TcpConnectionPtr& conn);
-
-    void handleMessage(const TcpConnectionPtr& conn, Buffer& buffer);
-
-    void sendResponse(const TcpConnectionPtr& conn, const json::Value& response);
+    void onMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer);
+    void onHighWaterMark(const SessionPtr& session, const TcpConnectionPtr& conn, size_t mark);
+    void onWriteComplete(const SessionPtr& session, const TcpConnectionPtr& conn);
+    void onRequestDone(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer* buffer);
+    void resumeMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer* buffer);
+
+    struct DeferredRequest {
+        mudong::json::Value request;
+        RpcDoneCallback done;
+        FlowControlPtr flow;
+        StreamReaderPtr upload;
+        EventLoop* loop;
+    };
+
+    void handleMessage(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer, FrameHeader& frame);
+    void readRequests(const SessionPtr& session, const TcpConnectionPtr& conn, Buffer& buffer, FrameHeader& frame,
+                      std::vector<DeferredRequest>& deferred);
+    void dispatchDeferred(std::vector<DeferredRequest>& deferred);
+    void handleUploadMessage(const SessionPtr& session, mudong::json::Value& message, size_t bytes);
+    bool openUpload(const SessionPtr& session, const FrameHeader& frame, mudong::json::Value& request, StreamReaderPtr& upload);
+    bool handleSubscription(const SessionPtr& session, const FrameHeader& frame, mudong::json::Value& request);
+    void rejectDraining(const SessionPtr& session, const FrameHeader& frame, const mudong::json::Value& request);
+    void onRequestFinished();
+    void checkDrained();
+    void closeConnections(bool force);
+    void closeConnection(const TcpConnectionPtr& conn, bool force);
+    void finishDrain();
+
+    void sendResponse(const SessionPtr& session, FrameType type, Codec codec, const json::Value& response);
+    void sendCachedResponse(const SessionPtr& session, FrameType type, Codec codec, const json::Value& id, const CachedResult& cached);
+    size_t compressThresholdFor(const SessionPtr& session) const {
+        return session->peerAcceptsCompression() ? compressThreshold_ : kNoCompression;
+    }
 
     ProtocolServer& convert(); // 将Base转换为子类对象类型，CRTP
     const ProtocolServer& convert() const;
@@ -46,7 +157,35 @@ protected:
     mudong::json::Value wrapException(RequestException& e);
 
 private:
-    TcpServer server_;
+    void createTcpServer();
+
+private:
+    EventLoop* loop_;
+    const InetAddress tcpAddress_; // 构造时传入的TCP地址，只监听unix socket时不使用
+    const bool listenTcp_;
+    // 二者至多一个非空，由setReusePort决定。TcpServer构造时即bind，推迟到start时创建，
+    // 否则继承监听socket的新进程会与仍持有SO_REUSEPORT socket的旧进程争用该地址
+    std::unique_ptr<TcpServer> tcpServer_;
+    std::unique_ptr<ReusePortServer> reusePortServer_;
+    std::vector<std::unique_ptr<UnixServer>> unixServers_;
+    size_t numThread_;
+    WriteCoalescing coalescing_;
+    size_t compressThreshold_;
+    size_t maxInFlightPerConnection_;
+    size_t messageBudget_;
+    size_t uploadWindow_;
+    PubSub pubsub_;
+
+    std::unique_ptr<UnixServer> handoffServer_;
+    std::atomic<size_t> inFlight_;  // 所有连接上正在处理的请求数，drain据此判断请求是否已全部完成
+    std::atomic<bool> draining_;
+    std::mutex mutex_;
+    std::unordered_set<TcpConnectionPtr> connections_; // drain时据此通知并关闭连接，guarded by mutex_
+    // 以下只在loop_所在线程中使用
+    std::function<void()> drainCallback_;
+    ev::Timer* drainTimer_;
+    bool closingConnections_;
+    bool drained_;
 }; // class BaseServer
 
 } // namespace rpc
@@ -0,0 +1,55 @@
+#include <cassert>
+#include <exception>
+#include <utility>
+
+#include "server/ConcurrencyLimiter.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+// 当前线程正在执行的排队任务列表。inline的procedure可能在task中同步完成并再次release，
+// 此时新出队的task追加到列表中由外层循环执行，而不是层层递归，调用栈深度与队列长度无关
+thread_local std::deque<ConcurrencyLimiter::Task>* tDraining = nullptr;
+
+} // anonymous namespace
+
+void ConcurrencyLimiter::release() {
+    Task task;
+    {
+        std::lock_guard lock(mutex_);
+        if (queue_.empty()) {
+            assert(inFlight_ > 0);
+            --inFlight_;
+            return;
+        }
+        // 名额直接转交给排队的请求，inFlight_不变
+        task = std::move(queue_.front());
+        queue_.pop_front();
+    }
+
+    if (tDraining != nullptr) {
+        tDraining->push_back(std::move(task));
+        return;
+    }
+
+    // 某个task抛出异常时也要执行完其余的task，它们各自占着名额；tDraining指向栈上的列表，返回前必须复位
+    std::deque<Task> draining;
+    draining.push_back(std::move(task));
+    tDraining = &draining;
+    std::exception_ptr error;
+    while (!draining.empty()) {
+        task = std::move(draining.front());
+        draining.pop_front();
+        try {
+            task();
+        }
+        catch (...) {
+            if (error == nullptr) error = std::current_exception();
+        }
+    }
+    tDraining = nullptr;
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "utils/util.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 并发准入控制：最多maxInFlight个请求同时执行，超出的最多排队maxQueued个，再多则直接拒绝，
+由调用者立刻回复过载错误，避免无限制地积压任务，让所有请求的延迟一起变差。
+请求完成时调用release归还名额，若有排队的请求则由release的调用线程接着执行task；
+需要在特定线程执行的请求由task自行投递，见RpcServer::invokeAdmitted
+ */
+class ConcurrencyLimiter : noncopyable {
+
+public:
+    using Task = std::function<void()>;
+
+    enum class Admit {
+        RUN,      // 已占用名额，调用者立即执行
+        QUEUED,   // 已放入等待队列，轮到时由release执行
+        REJECTED, // 名额和队列都已满
+    };
+
+    ConcurrencyLimiter(size_t maxInFlight, size_t maxQueued)
+            : maxInFlight_(maxInFlight),
+              maxQueued_(maxQueued),
+              inFlight_(0)
+    {}
+
+    // 可在任意线程调用，只有需要排队时才调用makeTask生成task，名额充足时不产生额外的开销；排队的task不应抛出异常
+    template <typename MakeTask>
+    Admit admit(MakeTask&& makeTask) {
+        std::lock_guard lock(mutex_);
+        if (inFlight_ < maxInFlight_) {
+            ++inFlight_;
+            return Admit::RUN;
+        }
+        if (queue_.size() < maxQueued_) {
+            queue_.push_back(makeTask());
+            return Admit::QUEUED;
+        }
+        return Admit::REJECTED;
+    }
+
+    // 可在任意线程调用，每个RUN或被执行的QUEUED请求完成时调用一次
+    void release();
+
+private:
+    const size_t maxInFlight_;
+    const size_t maxQueued_;
+
+    std::mutex mutex_;
+    size_t inFlight_;         // guarded by mutex_
+    std::deque<Task> queue_;  // guarded by mutex_
+}; // class ConcurrencyLimiter
+
+} // namespace rpc
+
+} // namespace mudong
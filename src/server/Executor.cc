@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include "server/Executor.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+// 当前线程所属的Executor及其worker下标，用于把worker线程内投递的任务放入自己的队列
+thread_local const Executor* tCurrentExecutor = nullptr;
+thread_local size_t tCurrentIndex = 0;
+
+} // anonymous namespace
+
+Executor::Executor(size_t numThreads)
+        : next_(0),
+          pending_(0),
+          sleeping_(0),
+          stop_(false)
+{
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads_.emplace_back(&Executor::runInThread, this, i);
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void Executor::submit(Task task, Priority priority) {
+    size_t index = tCurrentExecutor == this
+                   ? tCurrentIndex
+                   : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+    // 先计数再入队，pending_只会多算不会少算；与runInThread中"先增加sleeping_再检查pending_"配对，两边都是seq_cst，不会丢失唤醒
+    pending_.fetch_add(1, std::memory_order_seq_cst);
+    {
+        auto& worker = *workers_[index];
+        std::lock_guard lock(worker.mutex);
+        worker.tasks[static_cast<size_t>(priority)].push_back(std::move(task));
+    }
+    if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard lock(mutex_); }
+        cond_.notify_one();
+    }
+}
+
+void Executor::runInThread(size_t index) {
+    tCurrentExecutor = this;
+    tCurrentIndex = index;
+
+    Task task;
+    while (true) {
+        if (popLocal(index, task) || steal(index, task)) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(mutex_);
+        sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        cond_.wait(lock, [this]() {
+            return stop_ || pending_.load(std::memory_order_seq_cst) > 0;
+        });
+        sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        if (stop_ && pending_.load(std::memory_order_relaxed) == 0) break;
+    }
+}
+
+bool Executor::popLocal(size_t index, Task& task) {
+    auto& worker = *workers_[index];
+    std::lock_guard lock(worker.mutex);
+    auto& interactive = worker.tasks[static_cast<size_t>(Priority::INTERACTIVE)];
+    auto& bulk = worker.tasks[static_cast<size_t>(Priority::BULK)];
+
+    bool takeBulk = !bulk.empty() && (interactive.empty() || worker.interactiveStreak >= kMaxInteractiveStreak);
+    if (takeBulk) {
+        worker.interactiveStreak = 0;
+        task = std::move(bulk.back());
+        bulk.pop_back();
+        return true;
+    }
+    if (interactive.empty()) return false;
+
+    if (!bulk.empty()) {
+        ++worker.interactiveStreak;
+    }
+    task = std::move(interactive.back());
+    interactive.pop_back();
+    return true;
+}
+
+// 先在所有队列中找INTERACTIVE任务，都没有时再窃取BULK任务
+bool Executor::steal(size_t index, Task& task) {
+    size_t n = workers_.size();
+    for (size_t priority = 0; priority < kNumPriorities; ++priority) {
+        for (size_t i = 1; i < n; ++i) {
+            auto& victim = *workers_[(index + i) % n];
+            std::lock_guard lock(victim.mutex);
+            auto& tasks = victim.tasks[priority];
+            if (tasks.empty()) continue;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils/util.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 由RpcServer统一管理的work-stealing线程池，procedure按spec.json中的声明投递到这里执行
+每个worker有自己的任务队列：worker线程内投递的任务放入自己的队列，从队尾取出（LIFO，缓存友好）；
+其他线程投递的任务轮流分配到各个队列；自己的队列为空时从其他队列的队头窃取（FIFO），
+避免所有线程争抢同一把锁，也避免个别线程忙碌而其他线程空闲。
+每个队列按Priority分为两级，INTERACTIVE的任务总是先于BULK执行；BULK有任务等待时，
+worker每连续执行kMaxInteractiveStreak个INTERACTIVE任务就执行一个BULK任务，避免其被饿死
+ */
+class Executor : noncopyable {
+
+public:
+    using Task = std::function<void()>;
+
+    // numThreads为0时使用CPU核数
+    explicit Executor(size_t numThreads = 0);
+    ~Executor(); // 执行完所有已投递的任务后退出
+
+    // 可在任意线程调用
+    void submit(Task task, Priority priority = Priority::INTERACTIVE);
+
+    size_t numThreads() const {
+        return threads_.size();
+    }
+
+private:
+    static const size_t kNumPriorities = 2;
+    static const size_t kMaxInteractiveStreak = 8;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks[kNumPriorities]; // 以Priority为下标
+        size_t interactiveStreak = 0;           // BULK等待期间连续执行的INTERACTIVE任务数，guarded by mutex
+    };
+
+    void runInThread(size_t index);
+    bool popLocal(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_;     // 外部线程投递时轮流选择队列
+    std::atomic<size_t> pending_;  // 所有队列中的任务总数
+    std::atomic<size_t> sleeping_; // 正在等待任务的worker数，为0时投递无需唤醒
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_; // guarded by mutex_
+}; // class Executor
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,102 @@
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "server/ListenerHandoff.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const uint32_t kHandoffMagic = 0x6d726864; // "mrhd"
+const size_t kMaxHandoffFds = 64;          // 远小于SCM_MAX_FD，一次sendmsg即可传完；接收端按此上限准备缓冲区
+const int kReceiveTimeoutSec = 5;
+
+struct Handoff {
+    uint32_t magic;
+    uint32_t count;
+};
+
+void closeFds(const int* fds, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (fds[i] != -1) ::close(fds[i]);
+    }
+}
+
+} // anonymous namespace
+
+bool ListenerHandoff::send(int connfd, const std::vector<int>& fds) {
+    // 监听socket的数量等于IO线程数，由使用者配置，超出上限时放弃交接，旧进程照常服务
+    if (fds.empty() || fds.size() > kMaxHandoffFds) {
+        ERROR("ListenerHandoff::send() cannot hand off {} listener(s), at most {}", fds.size(), kMaxHandoffFds);
+        return false;
+    }
+
+    Handoff handoff{kHandoffMagic, static_cast<uint32_t>(fds.size())};
+    struct iovec iov = {&handoff, sizeof(handoff)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size())); // new分配的内存满足cmsghdr的对齐要求
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    // 刚建立的连接发送缓冲区为空，这么小的消息总能一次发完
+    if (::sendmsg(connfd, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(handoff))) {
+        SYSERR("ListenerHandoff::send() sendmsg");
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> ListenerHandoff::receive(const UnixAddress& address) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        SYSERR("ListenerHandoff::receive() socket");
+        return {};
+    }
+    if (::connect(fd, address.getSockaddr(), address.getSocklen()) == -1) {
+        // 没有旧进程在等待交接，是第一次启动时的正常情况
+        INFO("ListenerHandoff::receive() no handoff on {}: {}", address.path(), strerror(errno));
+        ::close(fd);
+        return {};
+    }
+    // 旧进程accept之后立即发送，不会等太久；旧进程卡住时也不能让新进程一直无法启动
+    struct timeval timeout = {kReceiveTimeoutSec, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    Handoff handoff{};
+    struct iovec iov = {&handoff, sizeof(handoff)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxHandoffFds)] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    ::close(fd);
+
+    std::vector<int> fds;
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (n > 0 && cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        fds.resize((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * fds.size());
+    }
+    if (n != static_cast<ssize_t>(sizeof(handoff)) || (msg.msg_flags & MSG_CTRUNC) ||
+        handoff.magic != kHandoffMagic || handoff.count != fds.size() || fds.empty()) {
+        WARN("ListenerHandoff::receive() bad handoff from {}", address.path());
+        closeFds(fds.data(), fds.size());
+        return {};
+    }
+    INFO("ListenerHandoff::receive() {} listener(s) from {}", fds.size(), address.path());
+    return fds;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/util.hpp"
+#include "utils/UnixAddress.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 进程重启时监听socket的交接
+旧进程在一个unix socket上等待，新进程启动时连接该地址，旧进程以SCM_RIGHTS把自己的全部监听socket传给它，
+然后停止accept并开始drain。监听socket在交接前后始终处于listen状态，已在队列中和之后到来的连接都由新进程accept，
+重启期间不会有连接被拒绝
+ */
+class ListenerHandoff : noncopyable {
+
+public:
+    // 旧进程：在刚accept的unix socket上发送fds，最多64个，失败或超出上限时返回false
+    static bool send(int connfd, const std::vector<int>& fds);
+    // 新进程：连接旧进程的交接地址并接收监听socket；没有旧进程在等待或交接失败时返回空
+    static std::vector<int> receive(const UnixAddress& address);
+}; // class ListenerHandoff
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,70 @@
+#include <functional>
+
+#include "server/MethodTable.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+size_t hashName(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+}
+
+} // anonymous namespace
+
+void MethodTable::add(std::string_view serviceName, std::string_view methodName, ProcedureReturn* p) {
+    auto& entry = addEntry(serviceName, methodName);
+    assert(entry.procedureReturn == nullptr);
+    entry.procedureReturn = p;
+}
+
+void MethodTable::add(std::string_view serviceName, std::string_view methodName, ProcedureNotify* p) {
+    auto& entry = addEntry(serviceName, methodName);
+    assert(entry.procedureNotify == nullptr);
+    entry.procedureNotify = p;
+}
+
+// 构建阶段方法数量有限，线性查找同名项即可
+MethodTable::Entry& MethodTable::addEntry(std::string_view serviceName, std::string_view methodName) {
+    assert(!sealed_);
+    std::string name;
+    name.reserve(serviceName.length() + 1 + methodName.length());
+    name.append(serviceName).append(1, '.').append(methodName);
+
+    for (auto& entry : entries_) {
+        if (entry.name == name) return entry;
+    }
+    auto hash = hashName(name);
+    return entries_.emplace_back(Entry{std::move(name), hash, nullptr, nullptr});
+}
+
+void MethodTable::seal() {
+    assert(!sealed_);
+    sealed_ = true;
+
+    // 装载因子不超过1/2，探测长度很短
+    size_t n = 1;
+    while (n < entries_.size() * 2) n <<= 1;
+    slots_.assign(n, 0);
+    mask_ = n - 1;
+
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        size_t pos = entries_[i].hash & mask_;
+        while (slots_[pos] != 0) {
+            pos = (pos + 1) & mask_;
+        }
+        slots_[pos] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+const MethodTable::Entry* MethodTable::find(std::string_view name) const {
+    assert(sealed_);
+    auto hash = hashName(name);
+    for (size_t pos = hash & mask_; slots_[pos] != 0; pos = (pos + 1) & mask_) {
+        auto& entry = entries_[slots_[pos] - 1];
+        if (entry.hash == hash && entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
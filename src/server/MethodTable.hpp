@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server/Procedure.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 以完整方法名"serviceName.methodName"为key的扁平哈希表，开放寻址、线性探测
+server启动前由RpcServer一次性构建，之后只读，任意IO线程无需加锁即可查找；
+一次调用只需计算一次哈希并比较一次字符串，不再分别按service名和method名各查一次unordered_map
+ */
+class MethodTable : noncopyable {
+
+public:
+    struct Entry {
+        std::string name;                 // "serviceName.methodName"
+        size_t hash;
+        ProcedureReturn* procedureReturn; // 同名的procedure和notify可以同时存在，不存在的为nullptr
+        ProcedureNotify* procedureNotify;
+    };
+
+    MethodTable() = default;
+
+    // 构建阶段调用，seal之后不能再添加
+    void add(std::string_view serviceName, std::string_view methodName, ProcedureReturn* p);
+    void add(std::string_view serviceName, std::string_view methodName, ProcedureNotify* p);
+    void seal();
+
+    // 找不到返回nullptr
+    const Entry* find(std::string_view name) const;
+
+    // 按数字id查找，id即方法在entries()中的下标，seal之后不再变化；越界返回nullptr
+    const Entry* find(int64_t id) const {
+        if (id < 0 || static_cast<uint64_t>(id) >= entries_.size()) return nullptr;
+        return &entries_[static_cast<size_t>(id)];
+    }
+
+    const std::vector<Entry>& entries() const {
+        return entries_;
+    }
+
+private:
+    Entry& addEntry(std::string_view serviceName, std::string_view methodName);
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> slots_; // 下标+1，0表示空槽，长度为2的幂
+    size_t mask_ = 0;
+    bool sealed_ = false;
+}; // class MethodTable
+
+} // namespace rpc
+
+} // namespace mudong
@@ -1,8 +1,35 @@
 #include "utils/Exception.hpp"
 #include "server/Procedure.hpp"
+#include "server/Executor.hpp"
 
 using namespace mudong::rpc;
 
+namespace {
+
+// 与BaseServer::wrapException相同的error response，线程池中抛出的异常无法再回到IO线程的处理流程，在此直接回复
+mudong::json::Value wrapException(RequestException& e) {
+    mudong::json::Value response(mudong::json::ValueType::TYPE_OBJECT);
+    response.addMember("jsonrpc", "2.0");
+    auto& value = response.addMember("error", mudong::json::ValueType::TYPE_OBJECT);
+    value.addMember("code", e.err().asCode());
+    value.addMember("message", e.err().asString());
+    value.addMember("data", e.detail());
+    response.addMember("id", e.id());
+    return response;
+}
+
+// 在线程池中排队期间client可能已经放弃了，这种请求不必再执行
+bool checkDeadline(mudong::json::Value& request, const RpcDoneCallback& done, Deadline deadline) {
+    if (deadline == kNoDeadline || SteadyClock::now() < deadline) {
+        return true;
+    }
+    RequestException e(RpcError(ERROR::RPC_REQUEST_TIMEOUT), request["id"], "deadline exceeded before execution");
+    done(wrapException(e));
+    return false;
+}
+
+} // anonymous namespace
+
 // 模板特化声明
 template class Procedure<ProcedureReturnCallback>;
 template class Procedure<ProcedureNotifyCallback>;
@@ -74,14 +101,44 @@ bool Procedure<Func>::validateGeneric(json::Value& request) const {
 
 // ProcedureReturn只会调用此invoke，因此只需对该两形参的invoke模板函数进行实现
 template <>
-void Procedure<ProcedureReturnCallback>::invoke(json::Value& request, const RpcDoneCallback& done) {
-    validateRequest(request);
-    callback_(request, done);
+void Procedure<ProcedureReturnCallback>::invoke(json::Value& request, const RpcDoneCallback& done, Deadline deadline,
+                                                const FlowControlPtr& flow, const StreamReaderPtr& upload) {
+    validateRequest(request); // 参数校验仍在IO线程中完成，出错时由BaseServer统一回复
+    if (executor_ == nullptr) {
+        if (checkDeadline(request, done, deadline)) {
+            callback_(request, done, deadline, flow, upload);
+        }
+        return;
+    }
+
+    // Value为浅拷贝，按值捕获只增加引用计数
+    executor_->submit([this, request, done, deadline, flow, upload]() mutable {
+        try {
+            if (checkDeadline(request, done, deadline)) {
+                callback_(request, done, deadline, flow, upload);
+            }
+        }
+        catch (RequestException& e) {
+            done(wrapException(e));
+        }
+    }, priority_);
 }
 
 // ProcedureNotify只会调用此invoke，因此只需对该单形参的invoke模板函数进行实现
 template <>
 void Procedure<ProcedureNotifyCallback>::invoke(json::Value& request) {
     validateRequest(request);
-    callback_(request);
+    if (executor_ == nullptr) {
+        callback_(request);
+        return;
+    }
+
+    executor_->submit([this, request]() mutable {
+        try {
+            callback_(request);
+        }
+        catch (NotifyException& e) {
+            WARN("notify error, code:{}, message:{}, data:{}", e.err().asCode(), e.err().asString(), e.detail());
+        }
+    }, priority_);
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include <mudong-json/include/Value.hpp>
 
 #include "utils/util.hpp"
@@ -12,7 +16,14 @@ namespace mudong {
 
 namespace rpc {
 
-using ProcedureReturnCallback = std::function<void(mudong::json::Value&, const RpcDoneCallback&)>;
+class Executor;
+
+// procedure的执行位置：IO线程内直接执行、RpcServer的默认线程池，或RpcServer中以addExecutor添加的同名线程池
+constexpr std::string_view kInlineExecutor = "inline";
+constexpr std::string_view kDefaultExecutor = "pool";
+
+using ProcedureReturnCallback = std::function<void(mudong::json::Value&, const RpcDoneCallback&, Deadline, const FlowControlPtr&,
+                                                   const StreamReaderPtr&)>;
 using ProcedureNotifyCallback = std::function<void(mudong::json::Value&)>;
 
 template<typename Func>
@@ -31,11 +42,75 @@ public:
         }
     }
 
-    // procedure call
-    void invoke(mudong::json::Value& request, const RpcDoneCallback& done);
+    // procedure call，已过deadline的请求不再执行，直接回复REQUEST_TIMEOUT；flow只供流式返回的procedure使用，upload只供流式上传的procedure使用
+    void invoke(mudong::json::Value& request, const RpcDoneCallback& done, Deadline deadline = kNoDeadline,
+                const FlowControlPtr& flow = nullptr, const StreamReaderPtr& upload = nullptr);
     // procedure notify
     void invoke(mudong::json::Value& request);
 
+    // spec.json中声明的执行位置，RpcServer::start时据此绑定executor
+    void setExecutorName(std::string_view name) {
+        executorName_ = name;
+    }
+
+    std::string_view executorName() const {
+        return executorName_;
+    }
+
+    // spec.json中声明的延迟等级，投递到线程池时按此排队
+    void setPriority(Priority priority) {
+        priority_ = priority;
+    }
+
+    Priority priority() const {
+        return priority_;
+    }
+
+    // spec.json中声明为cacheable的procedure的结果有效期，0表示不缓存，见server/ResponseCache.hpp
+    void setCacheTtl(std::chrono::milliseconds ttl) {
+        cacheTtl_ = ttl;
+    }
+
+    std::chrono::milliseconds cacheTtl() const {
+        return cacheTtl_;
+    }
+
+    // spec.json中声明为coalesce的procedure，params相同的并发调用只执行一次，见server/SingleFlight.hpp
+    void setCoalesce(bool on) {
+        coalesce_ = on;
+    }
+
+    bool coalesce() const {
+        return coalesce_;
+    }
+
+    // spec.json中声明为stream的procedure，通过StreamWriter分块返回结果，见utils/util.hpp
+    void setStream(bool on) {
+        stream_ = on;
+    }
+
+    bool stream() const {
+        return stream_;
+    }
+
+    // spec.json中声明为upload的procedure，参数之外的数据由client分块上传，通过StreamReader逐块接收，见server/StreamReader.hpp
+    void setUpload(bool on) {
+        upload_ = on;
+    }
+
+    bool upload() const {
+        return upload_;
+    }
+
+    // 为nullptr时在IO线程中执行
+    void bindExecutor(Executor* executor) {
+        executor_ = executor;
+    }
+
+    bool isInline() const {
+        return executor_ == nullptr;
+    }
+
 private:
     template<typename Name, typename... ParamNameAndTypes>
     void initProcedure(Name paramName, mudong::json::ValueType paramType, ParamNameAndTypes&& ... nameAndType) {
@@ -64,6 +139,13 @@ private:
 
     Func callback_;
     std::vector<Param> params_;
+    std::string executorName_{kInlineExecutor};
+    Executor* executor_ = nullptr;
+    Priority priority_ = Priority::INTERACTIVE;
+    std::chrono::milliseconds cacheTtl_{0};
+    bool coalesce_ = false;
+    bool stream_ = false;
+    bool upload_ = false;
 }; // class Procedure
 
 using ProcedureReturn = Procedure<ProcedureReturnCallback>;
@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "server/PubSub.hpp"
+
+using namespace mudong::rpc;
+
+void PubSub::subscribe(const std::string& topic, const SessionPtr& session, FrameType type, Codec codec) {
+    std::lock_guard lock(mutex_);
+    auto& list = topics_[topic];
+    auto subscribers = list != nullptr ? std::make_shared<std::vector<Subscriber>>(*list)
+                                       : std::make_shared<std::vector<Subscriber>>();
+
+    auto it = std::find_if(subscribers->begin(), subscribers->end(), [&](const Subscriber& s) {
+        return s.key == session.get();
+    });
+    if (it != subscribers->end()) {
+        it->type = type;
+        it->codec = codec;
+    }
+    else {
+        subscribers->push_back(Subscriber{session, session.get(), type, codec});
+    }
+    list = std::move(subscribers);
+}
+
+void PubSub::unsubscribe(const std::string& topic, const Session* session) {
+    std::lock_guard lock(mutex_);
+    auto topicIter = topics_.find(topic);
+    if (topicIter == topics_.end()) return;
+
+    auto& list = topicIter->second;
+    auto it = std::find_if(list->begin(), list->end(), [&](const Subscriber& s) {
+        return s.key == session;
+    });
+    if (it == list->end()) return;
+
+    if (list->size() == 1) {
+        topics_.erase(topicIter);
+        return;
+    }
+    auto subscribers = std::make_shared<std::vector<Subscriber>>();
+    subscribers->reserve(list->size() - 1);
+    for (auto& s : *list) {
+        if (s.key != session) subscribers->push_back(s);
+    }
+    list = std::move(subscribers);
+}
+
+PubSub::SubscriberList PubSub::subscribers(const std::string& topic) const {
+    std::lock_guard lock(mutex_);
+    auto it = topics_.find(topic);
+    return it != topics_.end() ? it->second : nullptr;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/util.hpp"
+#include "codec/Frame.hpp"
+#include "server/Session.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 服务端推送的订阅表：client以rpc.subscribe订阅一个topic之后，server发布到该topic的消息以notify的形式
+{"jsonrpc":"2.0","method":topic,"params":...}
+推送给所有订阅了它的连接，帧类型和编码与订阅请求相同。
+发布远比订阅频繁，每个topic的订阅者列表写时复制：发布只在锁内取出列表的指针，遍历和发送都在锁外
+ */
+class PubSub : noncopyable {
+
+public:
+    struct Subscriber {
+        std::weak_ptr<Session> session; // 连接断开时由BaseServer退订，这里不延长Session的生命周期
+        const Session* key;             // 退订时按此比较，session已失效时仍然可用
+        FrameType type;
+        Codec codec;
+    };
+    using SubscriberList = std::shared_ptr<const std::vector<Subscriber>>;
+
+    // 同一连接重复订阅时只更新帧类型和编码
+    void subscribe(const std::string& topic, const SessionPtr& session, FrameType type, Codec codec);
+    void unsubscribe(const std::string& topic, const Session* session);
+
+    // 可在任意线程调用，没有订阅者时返回nullptr
+    SubscriberList subscribers(const std::string& topic) const;
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, SubscriberList> topics_; // guarded by mutex_
+}; // class PubSub
+
+} // namespace rpc
+
+} // namespace mudong
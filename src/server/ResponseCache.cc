@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+#include "codec/Message.hpp"
+#include "server/ResponseCache.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+/* 规范化的编码只用于比较，不需要能够解析回来，但必须是单射：
+每个值以类型标记开头，字符串和容器带上长度，int32和int64按数值统一，object的成员按名字排序
+ */
+void appendCanonical(const mudong::json::Value& value, std::string& key) {
+    switch (value.getType()) {
+        case mudong::json::ValueType::TYPE_NULL:
+            key.push_back('n');
+            break;
+        case mudong::json::ValueType::TYPE_BOOL:
+            key.push_back(value.getBool() ? 't' : 'f');
+            break;
+        case mudong::json::ValueType::TYPE_INT32:
+        case mudong::json::ValueType::TYPE_INT64:
+            key.push_back('i');
+            key.append(std::to_string(value.isInt32() ? value.getInt32() : value.getInt64()));
+            key.push_back(';');
+            break;
+        case mudong::json::ValueType::TYPE_DOUBLE: {
+            auto bits = std::bit_cast<uint64_t>(value.getDouble());
+            key.push_back('d');
+            key.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+            break;
+        }
+        case mudong::json::ValueType::TYPE_STRING: {
+            auto s = value.getStringView();
+            key.push_back('s');
+            key.append(std::to_string(s.length()));
+            key.push_back(':');
+            key.append(s);
+            break;
+        }
+        case mudong::json::ValueType::TYPE_ARRAY: {
+            size_t n = value.getSize();
+            key.push_back('[');
+            key.append(std::to_string(n));
+            key.push_back(':');
+            for (size_t i = 0; i < n; ++i) {
+                appendCanonical(value[i], key);
+            }
+            break;
+        }
+        case mudong::json::ValueType::TYPE_OBJECT: {
+            std::vector<const mudong::json::Member*> members;
+            members.reserve(value.getSize());
+            for (auto it = value.beginMember(); it != value.endMember(); ++it) {
+                members.push_back(&*it);
+            }
+            std::sort(members.begin(), members.end(), [](auto* lhs, auto* rhs) {
+                return lhs->key.getStringView() < rhs->key.getStringView();
+            });
+            key.push_back('{');
+            key.append(std::to_string(members.size()));
+            key.push_back(':');
+            for (auto* m : members) {
+                appendCanonical(m->key, key);
+                appendCanonical(m->value, key);
+            }
+            break;
+        }
+        default:
+            assert(false && "bad value type");
+    }
+}
+
+} // anonymous namespace
+
+ResponseCache::ResponseCache(size_t capacity)
+        : shards_(kNumShards),
+          shardCapacity_(std::max<size_t>(1, capacity / kNumShards))
+{}
+
+void ResponseCache::makeKey(size_t methodId, const mudong::json::Value* params, std::string& key) {
+    key.append(std::to_string(methodId));
+    key.push_back('/');
+    if (params != nullptr) {
+        appendCanonical(*params, key);
+    }
+}
+
+CachedResultPtr ResponseCache::find(const std::string& key) {
+    auto& shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(std::string_view(key));
+    if (it == shard.index.end()) {
+        return nullptr;
+    }
+    auto node = it->second;
+    if (SteadyClock::now() >= node->expire) {
+        shard.index.erase(it);
+        shard.lru.erase(node);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, node);
+    return node->result;
+}
+
+void ResponseCache::insert(const std::string& key, const mudong::json::Value& value, std::chrono::milliseconds ttl) {
+    // 序列化在锁外完成，之后只读，各线程共享同一份
+    auto result = std::make_shared<CachedResult>();
+    result->value = value;
+    encodeValue(result->encoded[static_cast<size_t>(Codec::JSON)], Codec::JSON, value);
+    encodeValue(result->encoded[static_cast<size_t>(Codec::MSGPACK)], Codec::MSGPACK, value);
+    auto expire = SteadyClock::now() + ttl;
+
+    auto& shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(std::string_view(key));
+    if (it != shard.index.end()) {
+        it->second->result = std::move(result);
+        it->second->expire = expire;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    if (shard.lru.size() >= shardCapacity_) {
+        shard.index.erase(std::string_view(shard.lru.back().key));
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Node{key, std::move(result), expire});
+    shard.index.emplace(std::string_view(shard.lru.front().key), shard.lru.begin());
+}
+
+ResponseCache::Shard& ResponseCache::shardOf(const std::string& key) {
+    return shards_[std::hash<std::string>()(key) % kNumShards];
+}
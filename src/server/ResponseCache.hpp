@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <mudong-json/include/Value.hpp>
+
+#include "utils/util.hpp"
+#include "codec/Frame.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 缓存的result，插入时按每种codec各序列化一次，之后只读。
+单个请求命中时直接以encoded拼装响应帧，不再经过handler和Writer；batch中的命中仍需组装为Value，使用value
+ */
+struct CachedResult {
+    static const size_t kNumCodecs = 2; // 以Codec的值为下标
+
+    mudong::json::Value value;
+    std::string encoded[kNumCodecs];
+
+    std::string_view encodedAs(Codec codec) const {
+        return encoded[static_cast<size_t>(codec)];
+    }
+};
+
+using CachedResultPtr = std::shared_ptr<const CachedResult>;
+
+/* spec.json中声明为cacheable的方法的结果缓存，key为方法id加规范化后的params，见makeKey。
+按key的哈希分为若干个分片，每个分片一把锁、各自按LRU淘汰，IO线程和worker线程可以并发访问；
+条目在插入时记下过期时间，查找时发现过期即删除
+ */
+class ResponseCache : noncopyable {
+
+public:
+    // capacity为所有分片合计的条目数上限
+    explicit ResponseCache(size_t capacity);
+
+    // 找不到或已过期返回nullptr
+    CachedResultPtr find(const std::string& key);
+
+    // 同一个key已存在时替换为新的结果
+    void insert(const std::string& key, const mudong::json::Value& value, std::chrono::milliseconds ttl);
+
+    // 同一方法下params相同的请求得到相同的key；object的成员按名字排序，与请求中的成员顺序无关
+    static void makeKey(size_t methodId, const mudong::json::Value* params, std::string& key);
+
+private:
+    struct Node {
+        std::string key;
+        CachedResultPtr result;
+        Deadline expire;
+    };
+    using NodeList = std::list<Node>;
+
+    struct Shard {
+        std::mutex mutex;
+        NodeList lru; // 表头为最近使用的条目，guarded by mutex
+        std::unordered_map<std::string_view, NodeList::iterator> index; // key指向lru中节点的key，guarded by mutex
+    };
+
+    Shard& shardOf(const std::string& key);
+
+    static const size_t kNumShards = 16;
+    std::vector<Shard> shards_;
+    const size_t shardCapacity_;
+}; // class ResponseCache
+
+} // namespace rpc
+
+} // namespace mudong
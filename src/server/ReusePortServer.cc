@@ -0,0 +1,192 @@
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server/ReusePortServer.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const int kListenBacklog = SOMAXCONN;
+// 一次读事件中最多accept的连接数，重连风暴时减少epoll_wait的次数，又不至于长时间占用IO线程
+const int kMaxAcceptPerEvent = 64;
+
+int createListenSocket(const InetAddress& local) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        SYSFATAL("ReusePortServer::socket()");
+    }
+    int on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1) {
+        SYSFATAL("ReusePortServer::setsockopt(SO_REUSEADDR)");
+    }
+    // 同一地址上的所有监听socket都必须设置SO_REUSEPORT，内核才会在它们之间分配新连接
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+        SYSFATAL("ReusePortServer::setsockopt(SO_REUSEPORT)");
+    }
+    if (::bind(fd, local.getSockaddr(), local.getSocklen()) == -1) {
+        SYSFATAL("ReusePortServer::bind() {}", local.toIpPort());
+    }
+    if (::listen(fd, kListenBacklog) == -1) {
+        SYSFATAL("ReusePortServer::listen() {}", local.toIpPort());
+    }
+    return fd;
+}
+
+} // anonymous namespace
+
+ReusePortServer::ReusePortServer(EventLoop* loop, const InetAddress& local)
+        : baseLoop_(loop),
+          local_(local),
+          numThreads_(1),
+          started_(false)
+{}
+
+ReusePortServer::~ReusePortServer() {
+    for (auto& acceptor : acceptors_) {
+        if (acceptor.loop != baseLoop_) {
+            acceptor.loop->quit();
+        }
+    }
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    if (!acceptors_.empty()) {
+        stopAcceptInLoop(0);
+        acceptors_[0].channels.clear();
+    }
+    for (int fd : listenfds_) {
+        ::close(fd);
+    }
+}
+
+void ReusePortServer::setNumThread(size_t n) {
+    baseLoop_->assertInLoopThread();
+    assert(n > 0);
+    assert(!started_);
+    numThreads_ = n;
+}
+
+void ReusePortServer::adoptListeners(std::vector<int> fds) {
+    baseLoop_->assertInLoopThread();
+    assert(!started_);
+    listenfds_ = std::move(fds);
+}
+
+void ReusePortServer::start() {
+    if (started_.exchange(true)) return;
+    baseLoop_->runInLoop(std::bind(&ReusePortServer::startInLoop, this));
+}
+
+void ReusePortServer::startInLoop() {
+    // 先在当前线程中全部bind并listen，地址被占用时在启动阶段就失败，而不是在某个IO线程中
+    size_t inherited = listenfds_.size();
+    while (listenfds_.size() < numThreads_) {
+        listenfds_.push_back(createListenSocket(local_));
+    }
+
+    acceptors_.resize(numThreads_);
+    acceptors_[0].loop = baseLoop_;
+
+    CountDownLatch latch(static_cast<int>(numThreads_ - 1));
+    for (size_t i = 1; i < numThreads_; ++i) {
+        threads_.emplace_back(&ReusePortServer::runInThread, this, i, std::ref(latch));
+    }
+    latch.wait();
+
+    listenInLoop(0);
+    INFO("ReusePortServer::start() listen on {} with {} acceptor(s), {} inherited",
+         local_.toIpPort(), listenfds_.size(), inherited);
+}
+
+void ReusePortServer::runInThread(size_t index, CountDownLatch& latch) {
+    EventLoop loop;
+    acceptors_[index].loop = &loop; // 各线程写入不同下标，latch保证startInLoop之后读取时已全部写完
+    listenInLoop(index);
+    latch.countDown();
+    loop.loop();
+    stopAcceptInLoop(index);
+    acceptors_[index].channels.clear();
+    acceptors_[index].loop = nullptr;
+}
+
+// 每个IO线程accept分给自己的监听socket
+void ReusePortServer::listenInLoop(size_t index) {
+    auto& acceptor = acceptors_[index];
+    for (size_t i = index; i < listenfds_.size(); i += numThreads_) {
+        int listenfd = listenfds_[i];
+        auto channel = std::make_unique<ev::Channel>(acceptor.loop, listenfd);
+        channel->setReadCallback(std::bind(&ReusePortServer::handleAccept, this, acceptor.loop, listenfd));
+        channel->enableRead();
+        acceptor.channels.push_back(std::move(channel));
+    }
+}
+
+void ReusePortServer::stopAccept() {
+    assert(started_);
+    // acceptors_在startInLoop中才创建，投递到baseLoop_之后再分发给各线程
+    baseLoop_->runInLoop([this]() {
+        for (size_t i = 0; i < acceptors_.size(); ++i) {
+            acceptors_[i].loop->runInLoop(std::bind(&ReusePortServer::stopAcceptInLoop, this, i));
+        }
+        INFO("ReusePortServer::stopAccept() {}", local_.toIpPort());
+    });
+}
+
+void ReusePortServer::stopAcceptInLoop(size_t index) {
+    for (auto& channel : acceptors_[index].channels) {
+        if (!channel->isNoneEvents()) channel->disableAll();
+    }
+}
+
+void ReusePortServer::handleAccept(EventLoop* loop, int listenfd) {
+    loop->assertInLoopThread();
+
+    for (int i = 0; i < kMaxAcceptPerEvent; ++i) {
+        struct sockaddr_in peer{};
+        socklen_t len = sizeof(peer);
+        int connfd = ::accept4(listenfd, reinterpret_cast<struct sockaddr*>(&peer), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd == -1) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                SYSERR("ReusePortServer::accept4()");
+            }
+            return;
+        }
+        establishConnection(loop, connfd, peer);
+    }
+}
+
+void ReusePortServer::establishConnection(EventLoop* loop, int connfd, const struct sockaddr_in& peer) {
+    InetAddress peerAddress;
+    peerAddress.setAddress(peer);
+
+    InetAddress localAddress;
+    struct sockaddr_in local{};
+    socklen_t len = sizeof(local);
+    if (::getsockname(connfd, reinterpret_cast<struct sockaddr*>(&local), &len) == -1) {
+        SYSERR("ReusePortServer::getsockname()");
+    }
+    localAddress.setAddress(local);
+
+    auto conn = std::make_shared<TcpConnection>(loop, connfd, localAddress, peerAddress);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&ReusePortServer::closeConnection, this, _1));
+    {
+        std::lock_guard lock(mutex_);
+        connections_.insert(conn);
+    }
+
+    conn->connectEstablished();
+    connectionCallback_(conn);
+}
+
+void ReusePortServer::closeConnection(const TcpConnectionPtr& conn) {
+    conn->getLoop()->assertInLoopThread();
+    connectionCallback_(conn);
+
+    std::lock_guard lock(mutex_);
+    connections_.erase(conn);
+}
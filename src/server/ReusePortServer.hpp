@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <mudong-ev/src/Channel.hpp>
+
+#include "utils/util.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 多acceptor的TCP监听，接口与TcpServer保持一致
+每个IO线程各自持有一个设置了SO_REUSEPORT、绑定在同一地址上的监听socket，由内核按四元组哈希把新连接分散到各个socket，
+连接在accept它的线程中直接建立，没有TcpServer中单个accept线程的瓶颈，也没有跨线程的转交。
+适合部署之后大量客户端同时重连的场景；代价是连接按哈希而非轮询分配，短时间内各线程的连接数未必均衡
+ */
+class ReusePortServer : noncopyable {
+
+public:
+    ReusePortServer(EventLoop* loop, const InetAddress& local);
+    ~ReusePortServer();
+
+    // 与TcpServer相同，n为处理IO的线程总数，包括loop所在的线程；每个线程至少一个监听socket
+    void setNumThread(size_t n);
+    void start();
+
+    // 需在start之前调用。使用从旧进程继承的监听socket，见server/ListenerHandoff.hpp；
+    // 不足线程数时再新建，多于线程数时多出的socket分给各线程轮流accept，继承来的socket都不会被遗漏
+    void adoptListeners(std::vector<int> fds);
+
+    // start之后在loop所在线程中调用，返回全部监听socket
+    const std::vector<int>& listenFds() const {
+        return listenfds_;
+    }
+
+    // 可在任意线程调用，各线程停止accept，监听socket保持打开，已在队列中的连接可由继承了socket的新进程accept
+    void stopAccept();
+
+    void setConnectionCallback(const ConnectionCallback& cb) {
+        connectionCallback_ = cb;
+    }
+
+    void setMessageCallback(const ev::MessageCallback& cb) {
+        messageCallback_ = cb;
+    }
+
+    void setWriteCompleteCallback(const ev::WriteCompleteCallback& cb) {
+        writeCompleteCallback_ = cb;
+    }
+
+private:
+    void startInLoop();
+    void runInThread(size_t index, CountDownLatch& latch);
+    void listenInLoop(size_t index);
+    void stopAcceptInLoop(size_t index);
+    void handleAccept(EventLoop* loop, int listenfd);
+    void establishConnection(EventLoop* loop, int connfd, const struct sockaddr_in& peer);
+    void closeConnection(const TcpConnectionPtr& conn);
+
+private:
+    EventLoop* baseLoop_;
+    const InetAddress local_;
+
+    size_t numThreads_;
+    std::atomic<bool> started_;
+    std::vector<int> listenfds_; // 第i个socket由第i % numThreads_个线程accept，start时全部bind并listen
+
+    // 每个IO线程一个，Channel只在所属线程中创建、修改和销毁
+    struct Acceptor {
+        EventLoop* loop;
+        std::vector<std::unique_ptr<ev::Channel>> channels;
+    };
+    std::vector<Acceptor> acceptors_; // 下标0为baseLoop_
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::unordered_set<TcpConnectionPtr> connections_; // 连接在各自的IO线程中建立和关闭，guarded by mutex_
+
+    ConnectionCallback connectionCallback_;
+    ev::MessageCallback messageCallback_;
+    ev::WriteCompleteCallback writeCompleteCallback_;
+}; // class ReusePortServer
+
+} // namespace rpc
+
+} // namespace mudong
@@ -1,4 +1,8 @@
-#include <mudong-json/include/Document.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <vector>
 
 #include "utils/Exception.hpp"
 #include "server/RpcService.hpp"
@@ -58,44 +62,104 @@ bool hasParams(const mudong::json::Value& request) {
     return request.findMember("params") != request.endMember();
 }
 
+const int64_t kMaxTimeoutMs = 7 * 24 * 3600 * 1000ll; // 一周，远小于steady_clock可表示的范围
+
+bool hasTimeout(const mudong::json::Value& request) {
+    return request.findMember("timeout") != request.endMember();
+}
+
+int64_t getInteger(const mudong::json::Value& value) {
+    return value.isInt32() ? value.getInt32() : value.getInt64();
+}
+
+// 与UserDoneCallback构造的成功响应相同
+mudong::json::Value resultResponse(const mudong::json::Value& id, const mudong::json::Value& result) {
+    mudong::json::Value response(mudong::json::ValueType::TYPE_OBJECT);
+    response.addMember("jsonrpc", "2.0");
+    response.addMember("id", id);
+    response.addMember("result", result);
+    return response;
+}
+
 // 判断是否为一个notify请求，notify没有id，json-rpc 2.0协议
 bool isNotify(const mudong::json::Value& request) {
     return request.findMember("id") == request.endMember();
 }
 
-class ThreadSafeBatchResponse {
+/* batch的响应集合，每个非notify的请求预先分配一个slot，按请求中的顺序输出
+每个slot只会被一个线程写入一次，写完后原子地递减剩余计数，不需要加锁；
+最后一个完成者按顺序组装数组并调用done，整个batch只序列化一次。
+计数额外多算分发方的个数，每个分发方分发完自己负责的请求后调用release释放，保证分发过程中不会提前完成
+ */
+class BatchResponse {
 
 public:
-    explicit ThreadSafeBatchResponse(const RpcDoneCallback& done)
-            : data_(std::make_shared<ThreadSafeData>(done))
+    // numDispatchers为分发方的个数，每个分发方分发完后各调用一次release
+    BatchResponse(size_t numSlots, size_t numDispatchers, const RpcDoneCallback& done)
+            : state_(std::make_shared<State>(numSlots, numDispatchers, done))
     {}
 
-    void addResponse(const mudong::json::Value& response) {
-        std::lock_guard lock(data_->mutex);
-        data_->responses.addValue(response);
+    // 可在任意线程调用，每个slot恰好调用一次set或skip
+    void set(size_t slot, const mudong::json::Value& response) const {
+        assert(slot < state_->numSlots);
+        state_->slots[slot] = response;
+        finishOne();
+    }
+
+    void release() const {
+        finishOne();
     }
 
 private:
-    // 给vector<Value>包装一下，添加了mutex和callback对象，使用的时候都lock一下
-    struct ThreadSafeData {
-        explicit ThreadSafeData(const RpcDoneCallback& done_)
-                : responses(mudong::json::ValueType::TYPE_ARRAY),
+    void finishOne() const {
+        // acq_rel保证最后一个完成者能看到其他线程对slot的写入
+        if (state_->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            state_->complete();
+        }
+    }
+
+    struct State {
+        State(size_t numSlots_, size_t numDispatchers, const RpcDoneCallback& done_)
+                : numSlots(numSlots_),
+                  slots(std::make_unique<mudong::json::Value[]>(numSlots_)),
+                  remaining(numSlots_ + numDispatchers),
                   done(done_)
         {}
 
-        ~ThreadSafeData() {
-            done(responses); // 最后一个指向data的智能指针也析构了，因此执行callback通知RPC server处理完成了
+        void complete() {
+            mudong::json::Value responses(mudong::json::ValueType::TYPE_ARRAY);
+            for (size_t i = 0; i < numSlots; ++i) {
+                if (!slots[i].isNull()) {
+                    responses.addValue(slots[i]);
+                }
+            }
+            // 全部是notify时按协议不返回任何内容
+            done(responses.getSize() > 0 ? responses : mudong::json::Value());
         }
 
-        std::mutex mutex;
-        mudong::json::Value responses; // 这里Value类型的作用就是一个带引用计数的vector<Value>
+        const size_t numSlots;
+        std::unique_ptr<mudong::json::Value[]> slots; // 未填充的slot为null，组装时跳过
+        std::atomic<size_t> remaining;
         RpcDoneCallback done;
     };
 
-    using DataPtr = std::shared_ptr<ThreadSafeData>;
-    DataPtr data_;
+    std::shared_ptr<State> state_;
 };
 
+// 超时和过载的错误由server产生而不是procedure的结果，不能共享给合并的调用
+bool isSharedResult(const mudong::json::Value& response) {
+    auto error = response.findMember("error");
+    if (error == response.endMember()) {
+        return true;
+    }
+    auto code = error->value.findMember("code");
+    if (code == error->value.endMember() || !code->value.isInt32()) {
+        return true;
+    }
+    int32_t value = code->value.getInt32();
+    return value != RpcError(ERROR::RPC_REQUEST_TIMEOUT).asCode() && value != RpcError(ERROR::RPC_SERVER_OVERLOADED).asCode();
+}
+
 } // anonymous namespace
 
 void RpcServer::addService(std::string_view serviceName, RpcService* service) {
@@ -103,87 +167,437 @@ void RpcServer::addService(std::string_view serviceName, RpcService* service) {
     services_.emplace(serviceName, service);
 }
 
-void RpcServer::handleRequest(const std::string& json, const RpcDoneCallback& done) {
-    mudong::json::Document request;
-    mudong::json::ParseError err = request.parse(json);
-    if (err != mudong::json::ParseError::PARSE_OK) {
-        throw RequestException(RpcError(ERROR::RPC_PARSE_ERROR), mudong::json::parseErrorStr(err));
+void RpcServer::addExecutor(std::string_view name, size_t numThreads) {
+    assert(name != kInlineExecutor && name != kDefaultExecutor);
+    assert(namedExecutors_.find(std::string(name)) == namedExecutors_.end());
+    namedExecutors_.emplace(name, std::make_unique<Executor>(numThreads));
+}
+
+void RpcServer::setConcurrencyLimit(size_t maxInFlight, size_t maxQueued) {
+    assert(maxInFlight > 0);
+    globalLimiter_ = std::make_unique<ConcurrencyLimiter>(maxInFlight, maxQueued);
+}
+
+void RpcServer::setMethodConcurrencyLimit(std::string_view method, size_t maxInFlight, size_t maxQueued) {
+    assert(maxInFlight > 0);
+    methodLimits_[std::string(method)] = ConcurrencyLimit{maxInFlight, maxQueued};
+}
+
+Executor& RpcServer::executor() {
+    std::call_once(executorOnce_, [this]() {
+        executor_ = std::make_unique<Executor>(numWorkerThread_);
+    });
+    return *executor_;
+}
+
+void RpcServer::start() {
+    // IO线程在BaseServer::start之后才创建，构建完成的方法表对它们可见，之后不再修改
+    bool hasCacheableMethods = false;
+    bool hasCoalescedMethods = false;
+    bool hasPoolMethods = false;
+    for (auto& [serviceName, service] : services_) {
+        service->forEachProcedure([&, name = serviceName](std::string_view methodName, auto* p) {
+            p->bindExecutor(resolveExecutor(p->executorName()));
+            hasBulkMethods_ = hasBulkMethods_ || p->priority() == Priority::BULK;
+            hasUploadMethods_ = hasUploadMethods_ || p->upload();
+            hasCacheableMethods = hasCacheableMethods || p->cacheTtl().count() > 0;
+            hasCoalescedMethods = hasCoalescedMethods || p->coalesce();
+            hasPoolMethods = hasPoolMethods || p->executorName() == kDefaultExecutor;
+            methodTable_.add(name, methodName, p);
+        });
+    }
+    methodTable_.seal();
+
+    // 没有pool方法时不创建默认线程池，batch也就在IO线程中顺序分发
+    if (batchParallelThreshold_ > 0 && hasPoolMethods) {
+        batchExecutor_ = &executor();
     }
 
+    if (hasCacheableMethods && responseCacheCapacity_ > 0) {
+        responseCache_ = std::make_unique<ResponseCache>(responseCacheCapacity_);
+    }
+    if (hasCoalescedMethods) {
+        singleFlight_ = std::make_unique<SingleFlight>();
+    }
+
+    methodLimiters_.resize(methodTable_.entries().size());
+    for (auto& [name, limit] : methodLimits_) {
+        auto entry = methodTable_.find(std::string_view(name));
+        if (entry == nullptr) {
+            FATAL("RpcServer::start() concurrency limit for unknown method '{}'", name);
+        }
+        methodLimiters_[methodIndex(entry)] = std::make_unique<ConcurrencyLimiter>(limit.maxInFlight, limit.maxQueued);
+    }
+
+    methodIds_ = mudong::json::Value(mudong::json::ValueType::TYPE_OBJECT);
+    auto& entries = methodTable_.entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        methodIds_.addMember(mudong::json::Value(entries[i].name), mudong::json::Value(static_cast<int32_t>(i)));
+    }
+    BaseServer::start();
+}
+
+void RpcServer::handleRequest(mudong::json::Value& request, const RpcDoneCallback& done, const FlowControlPtr& flow,
+                              const StreamReaderPtr& upload, EventLoop* loop) {
+    auto received = SteadyClock::now(); // 请求中的timeout从此刻开始计算
     switch (request.getType()) {
         case mudong::json::ValueType::TYPE_OBJECT:
-            // Document is a Value，继承关系，里氏替换原则
             if (isNotify(request)) {
                 handleSingleNotify(request);
             }
             else {
-                handleSingleRequest(request, done);
+                handleSingleRequest(request, done, received, flow, upload, loop);
             }
             break;
         case mudong::json::ValueType::TYPE_ARRAY:
-            handleBatchRequests(request, done);
+            handleBatchRequests(request, done, received, loop);
             break;
         default:
             throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "request should be json object or array");
     }
 }
 
-void RpcServer::handleSingleRequest(mudong::json::Value& request, const RpcDoneCallback& done) {
+Priority RpcServer::requestPriority(const mudong::json::Value& request) const {
+    if (!hasBulkMethods_) {
+        return Priority::INTERACTIVE;
+    }
+    auto entry = peekMethod(request);
+    if (entry == nullptr) {
+        return Priority::INTERACTIVE;
+    }
+    if (isNotify(request)) {
+        return entry->procedureNotify != nullptr ? entry->procedureNotify->priority() : Priority::INTERACTIVE;
+    }
+    return entry->procedureReturn != nullptr ? entry->procedureReturn->priority() : Priority::INTERACTIVE;
+}
+
+bool RpcServer::isUploadRequest(const mudong::json::Value& request) const {
+    if (!hasUploadMethods_ || !request.isObject() || isNotify(request)) {
+        return false;
+    }
+    auto entry = peekMethod(request);
+    return entry != nullptr && entry->procedureReturn != nullptr && entry->procedureReturn->upload();
+}
+
+CachedResultPtr RpcServer::findCachedResult(mudong::json::Value& request) {
+    if (responseCache_ == nullptr || !request.isObject() || isNotify(request)) {
+        return nullptr;
+    }
+    auto entry = peekMethod(request);
+    if (!isCacheable(entry)) {
+        return nullptr;
+    }
+    validateRequest(request); // 不合法的请求即使key相同也不能以缓存回复
+    return responseCache_->find(callKey(entry, request));
+}
+
+void RpcServer::handleSingleRequest(mudong::json::Value& request, const RpcDoneCallback& done, SteadyClock::time_point received,
+                                    const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop) {
+    auto entry = resolveRequest(request, done, flow, upload);
+    if (entry != nullptr) {
+        dispatchRequest(entry, request, done, received, flow, upload, loop);
+    }
+}
+
+// 校验请求并查找方法，不合法时抛出异常；rpc.methods在此直接回复，返回nullptr
+const MethodTable::Entry* RpcServer::resolveRequest(mudong::json::Value& request, const RpcDoneCallback& done,
+                                                    const FlowControlPtr& flow, const StreamReaderPtr& upload) {
     validateRequest(request);
 
     auto& id = request["id"];
-    auto methodName = request["method"].getStringView();
-    // 格式为"method":"serviceName.methodName"
-    auto pos = methodName.find('.');
-    if (pos == std::string_view::npos) {
-        throw RequestException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), id, "missing service name in method");
+    auto& method = request["method"];
+    if (method.isString() && method.getStringView() == kMethodIdsMethod) {
+        handleMethodIds(request, done);
+        return nullptr;
+    }
+
+    // 格式为"method":"serviceName.methodName"，或者rpc.methods协商得到的数字id，直接查表
+    auto entry = findMethod(method);
+    if (entry == nullptr || entry->procedureReturn == nullptr) {
+        throw RequestException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), id, "method not found");
+    }
+    // batch的响应是一个整体，无法分块发送
+    if (entry->procedureReturn->stream() && flow == nullptr) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), id, "stream method is not allowed in batch");
+    }
+    // 上传的数据以id与调用对应，只有连接层登记过的单个请求才有接收端
+    if (entry->procedureReturn->upload() && upload == nullptr) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), id, "upload method must be a single request with an integer id");
+    }
+    return entry;
+}
+
+void RpcServer::dispatchRequest(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& done,
+                                SteadyClock::time_point received, const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop) {
+    auto& id = request["id"];
+
+    // batch中的请求只在这里查缓存，单个请求在连接层查过后这里会再查一次，相比执行procedure开销可以忽略；
+    // 未命中时成功的响应在回复之后写入缓存
+    RpcDoneCallback reply = done;
+    bool cacheable = isCacheable(entry);
+    bool coalesce = entry->procedureReturn->coalesce();
+    std::string key;
+    if (cacheable || coalesce) {
+        key = callKey(entry, request);
+    }
+    if (cacheable) {
+        if (auto cached = responseCache_->find(key)) {
+            done(resultResponse(id, cached->value));
+            return;
+        }
+        reply = [this, done, key, ttl = entry->procedureReturn->cacheTtl()](mudong::json::Value response) {
+            done(response);
+            auto result = response.findMember("result");
+            if (result != response.endMember()) {
+                responseCache_->insert(key, result->value, ttl);
+            }
+        };
     }
 
-    auto serviceName = methodName.substr(0, pos);
-    auto it = services_.find(serviceName);
-    if (it == services_.end()) {
-        throw RequestException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), id, "service not found");
+    // client已经放弃的请求不再占用准入名额和CPU，直接回复超时；之后在线程池中排队后还会再检查一次，见Procedure::invoke
+    auto deadline = kNoDeadline;
+    if (hasTimeout(request)) {
+        // 过大的timeout加到time_point上会溢出，超过上限的视为不限时
+        int64_t timeout = getInteger(request["timeout"]);
+        if (timeout <= kMaxTimeoutMs) {
+            deadline = received + std::chrono::milliseconds(timeout);
+        }
+        if (SteadyClock::now() >= deadline) {
+            RequestException e(RpcError(ERROR::RPC_REQUEST_TIMEOUT), id, "deadline exceeded before dispatch");
+            done(wrapException(e));
+            return;
+        }
     }
 
-    methodName.remove_prefix(pos + 1); //移除service name和'.'
-    if (methodName.length() == 0) {
-        throw RequestException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), id, "missing method name in method field");
+    if (!coalesce) {
+        invokeAdmitted(entry, request, reply, deadline, flow, upload, loop, 0);
+        return;
     }
 
-    // 只需要确保service name正确存在即可，对methodName的检查将交由对应的service执行，此处不进行检查
-    auto& service = it->second;
-    service->callProcedureReturn(methodName, request, done);
+    invokeCoalesced(entry, request, reply, done, key, deadline, flow, upload, loop);
 }
 
-// batch requests就是一个array类型的Value，其中可能包含request，也可能是notify，需要分类处理
-void RpcServer::handleBatchRequests(mudong::json::Value& requests, const RpcDoneCallback& done) {
+/* 已有相同的调用在执行时挂起，等它完成后以同一个结果回复；挂起的调用不占用准入名额。
+执行者先以reply回复自己并写入缓存，再回复挂起的调用，之后到达的相同调用可以直接命中缓存。
+执行者超时或过载时没有可共享的结果，挂起的调用以各自的reply重新分发；
+同步抛出的异常也要让挂起的调用得到回复，否则它们会一直挂起
+ */
+void RpcServer::invokeCoalesced(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& reply,
+                                const RpcDoneCallback& done, const std::string& key, Deadline deadline,
+                                const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop) {
+    auto redispatch = [this, entry, request, reply, done, key, deadline, flow, upload, loop]() mutable {
+        try {
+            invokeCoalesced(entry, request, reply, done, key, deadline, flow, upload, loop);
+        }
+        catch (RequestException& e) {
+            done(wrapException(e));
+        }
+    };
+    if (!singleFlight_->join(key, request["id"], done, deadline, redispatch)) {
+        return;
+    }
+
+    // procedure先回复再抛出异常时只结束一次，否则可能结束掉之后相同调用的新一轮执行
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    auto settle = [this, key, finished](const mudong::json::Value& response) {
+        if (finished->exchange(true)) return;
+        if (isSharedResult(response)) {
+            singleFlight_->finish(key, response);
+        }
+        else {
+            singleFlight_->abandon(key);
+        }
+    };
+    RpcDoneCallback leader = [reply, settle](mudong::json::Value response) {
+        reply(response);
+        settle(response);
+    };
+    try {
+        invokeAdmitted(entry, request, leader, deadline, flow, upload, loop, 0);
+    }
+    catch (RequestException& e) {
+        settle(wrapException(e));
+        throw;
+    }
+}
+
+/* level 0为方法的准入限制，level 1为全局的准入限制，之后执行procedure。
+立即执行时异常照常抛给调用者，与不限流时的处理相同；排队的请求轮到时投递回连接的IO线程执行，
+inline的procedure不会跑到worker线程或其他连接的IO线程上，异常只能直接回复。
+过载时直接回复错误而不抛异常，BaseServer对异常的处理是断开连接，过载的客户端只需稍后重试
+ */
+void RpcServer::invokeAdmitted(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& done, Deadline deadline,
+                               const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop, int level) {
+    ConcurrencyLimiter* limiter = nullptr;
+    if (level == 0) {
+        limiter = methodLimiters_[methodIndex(entry)].get();
+    }
+    else if (level == 1) {
+        limiter = globalLimiter_.get();
+    }
+    else {
+        entry->procedureReturn->invoke(request, done, deadline, flow, upload);
+        return;
+    }
+
+    if (limiter == nullptr) {
+        invokeAdmitted(entry, request, done, deadline, flow, upload, loop, level + 1);
+        return;
+    }
+
+    // 最终的响应交给连接层之后归还名额，流式响应的各块不算。
+    // procedure可能先回复再抛出异常，回复和异常处理两条路径共用一个标志，名额只归还一次
+    auto released = std::make_shared<std::atomic<bool>>(false);
+    auto release = [limiter, released]() {
+        if (!released->exchange(true)) {
+            limiter->release();
+        }
+    };
+    RpcDoneCallback next = [done, release](mudong::json::Value response) {
+        bool last = !isStreamChunk(response);
+        done(response);
+        if (last) {
+            release();
+        }
+    };
+
+    auto admit = limiter->admit([&]() -> ConcurrencyLimiter::Task {
+        auto task = [this, entry, request, next, released, deadline, flow, upload, loop, level]() mutable {
+            try {
+                invokeAdmitted(entry, request, next, deadline, flow, upload, loop, level + 1);
+            }
+            catch (RequestException& e) {
+                if (!released->load()) {
+                    next(wrapException(e));
+                }
+            }
+        };
+        if (loop == nullptr) {
+            return task;
+        }
+        return [loop, task = std::move(task)]() {
+            loop->runInLoop(task);
+        };
+    });
+
+    switch (admit) {
+        case ConcurrencyLimiter::Admit::RUN:
+            try {
+                invokeAdmitted(entry, request, next, deadline, flow, upload, loop, level + 1);
+            }
+            catch (...) {
+                release();
+                throw;
+            }
+            break;
+        case ConcurrencyLimiter::Admit::QUEUED:
+            break;
+        case ConcurrencyLimiter::Admit::REJECTED: {
+            RequestException e(RpcError(ERROR::RPC_SERVER_OVERLOADED), request["id"], "too many requests in flight");
+            done(wrapException(e));
+            break;
+        }
+    }
+}
+
+/* batch requests就是一个array类型的Value，其中可能包含request，也可能是notify，需要分类处理
+每个元素相互独立，出错的元素只产生它自己的错误响应，不影响其余元素。
+元素个数达到batchParallelThreshold_时，将batch切分为若干段投递到线程池并发地校验和查表，
+不再由一个IO线程串行处理整个batch；声明为inline的procedure仍投递回连接的IO线程执行，见dispatchBatch
+ */
+void RpcServer::handleBatchRequests(mudong::json::Value& requests, const RpcDoneCallback& done, SteadyClock::time_point received, EventLoop* loop) {
     size_t num = requests.getSize();
     if (num == 0) {
         throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "batch request is empty");
     }
 
-    ThreadSafeBatchResponse responses(done); // 可能存在竞态的点，因此用线程安全的自定义数据类型来存储结果responses的集合
+    size_t numChunks = 1;
+    if (batchExecutor_ != nullptr && num >= batchParallelThreshold_) {
+        numChunks = std::min(batchExecutor_->numThreads(), (num + kMinBatchChunk - 1) / kMinBatchChunk);
+    }
+    size_t chunkLen = (num + numChunks - 1) / numChunks;
+
+    // 非object的元素同样要回复一个错误，因此也占一个slot；顺带记下每一段的第一个slot
+    std::vector<size_t> firstSlots(numChunks, 0);
+    size_t numSlots = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (i % chunkLen == 0) {
+            firstSlots[i / chunkLen] = numSlots;
+        }
+        auto& request = requests[i];
+        if (!request.isObject() || !isNotify(request)) {
+            ++numSlots;
+        }
+    }
 
-    try {
-        size_t n = requests.getSize();
-        for (size_t i = 0; i < n; ++i) {
-            auto& request = requests[i];
+    BatchResponse responses(numSlots, numChunks, done); // 各请求可能在不同的worker线程完成，slot各自独立写入
 
-            if (!request.isObject()) {
-                throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "request should be json object");
+    if (numChunks == 1) {
+        dispatchBatch(requests, 0, num, 0, responses, received, loop);
+        return;
+    }
+
+    // Value为浅拷贝，按值捕获只增加引用计数
+    for (size_t c = 0; c < numChunks; ++c) {
+        size_t begin = c * chunkLen;
+        size_t end = std::min(num, begin + chunkLen);
+        batchExecutor_->submit([this, requests, begin, end, slot = firstSlots[c], responses, received, loop]() mutable {
+            dispatchBatch(requests, begin, end, slot, responses, received, loop);
+        });
+    }
+}
+
+template <typename Responses>
+void RpcServer::dispatchBatch(mudong::json::Value& requests, size_t begin, size_t end, size_t slot, const Responses& responses,
+                              SteadyClock::time_point received, EventLoop* loop) {
+    // 并发分发时本函数在worker线程中执行，这里只做校验和查表；inline的procedure依赖在IO线程中执行，投递回连接的IO线程分发
+    bool onWorker = loop != nullptr && !loop->isInLoopThread();
+    for (size_t i = begin; i < end; ++i) {
+        auto& request = requests[i];
+
+        if (request.isObject() && isNotify(request)) {
+            auto entry = onWorker ? peekMethod(request) : nullptr;
+            if (entry != nullptr && entry->procedureNotify != nullptr && entry->procedureNotify->isInline()) {
+                loop->runInLoop([this, request]() mutable {
+                    dispatchBatchNotify(request);
+                });
+                continue;
             }
+            dispatchBatchNotify(request);
+            continue;
+        }
 
-            if (isNotify(request)) {
-                handleSingleNotify(request);
+        size_t current = slot++;
+        RpcDoneCallback done = [responses, current](mudong::json::Value response){ responses.set(current, response); };
+        try {
+            if (!request.isObject()) {
+                throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), "request should be json object");
             }
-            else {
-                handleSingleRequest(request, [&](mudong::json::Value response){ responses.addResponse(response); }); // 执行完之后通过done将结果response添加进结果集当中，thread safe
+            auto entry = resolveRequest(request, done, nullptr, nullptr);
+            if (entry == nullptr) continue;
+            if (onWorker && entry->procedureReturn->isInline()) {
+                loop->runInLoop([this, entry, request, done, received, loop, responses, current]() mutable {
+                    try {
+                        dispatchRequest(entry, request, done, received, nullptr, nullptr, loop);
+                    }
+                    catch (RequestException& e) {
+                        responses.set(current, wrapException(e));
+                    }
+                });
+                continue;
             }
+            dispatchRequest(entry, request, done, received, nullptr, nullptr, loop);
+        }
+        catch (RequestException& e) {
+            responses.set(current, wrapException(e));
         }
     }
-    catch (RequestException& e) {
-        auto response = wrapException(e);
-        responses.addResponse(response);
+    responses.release();
+}
+
+void RpcServer::dispatchBatchNotify(mudong::json::Value& request) {
+    try {
+        handleSingleNotify(request);
     }
     catch (NotifyException& e) {
         // notify失败是无需给用户返回信息的，因此notify成功与否，用户都应该能接受其结果，用户逻辑不应依赖于notify的成功
@@ -195,25 +609,64 @@ void RpcServer::handleSingleNotify(mudong::json::Value& request) {
     validateNotify(request);
 
     // 找到匹配的service.method
-    auto methodName = request["method"].getStringView();
-    auto pos = methodName.find(".");
-    if (pos == std::string_view::npos || pos == 0) {
-        throw NotifyException(RpcError(ERROR::RPC_INVALID_REQUEST), "missing service name in method field");
+    auto entry = findMethod(request["method"]);
+    if (entry == nullptr || entry->procedureNotify == nullptr) {
+        throw NotifyException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), "method not found");
     }
+    entry->procedureNotify->invoke(request);
+}
+
+Executor* RpcServer::resolveExecutor(std::string_view name) {
+    if (name == kInlineExecutor) return nullptr;
+    if (name == kDefaultExecutor) return &executor();
 
-    auto serviceName = methodName.substr(0, pos);
-    auto it = services_.find(serviceName);
-    if (it == services_.end()) {
-        throw NotifyException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), "service not found");
+    auto it = namedExecutors_.find(std::string(name));
+    if (it == namedExecutors_.end()) {
+        FATAL("RpcServer::start() executor '{}' not found, add it by RpcServer::addExecutor()", name);
     }
+    return it->second.get();
+}
 
-    methodName.remove_prefix(pos + 1);
-    if (methodName.size() == 0) {
-        throw NotifyException(RpcError(ERROR::RPC_INVALID_REQUEST), "missing method name in method field");
+const MethodTable::Entry* RpcServer::findMethod(const mudong::json::Value& method) const {
+    if (method.isString()) {
+        return methodTable_.find(method.getStringView());
     }
+    return methodTable_.find(static_cast<int64_t>(method.getInt32()));
+}
+
+// 不做完整校验，只为分发之前的查询取出请求对应的方法，找不到返回nullptr
+const MethodTable::Entry* RpcServer::peekMethod(const mudong::json::Value& request) const {
+    if (!request.isObject()) {
+        return nullptr;
+    }
+    auto method = request.findMember("method");
+    if (method == request.endMember() || !(method->value.isString() || method->value.isInt32())) {
+        return nullptr;
+    }
+    return findMethod(method->value);
+}
 
-    auto& service = it->second;
-    service->callProcedureNotify(methodName, request);
+bool RpcServer::isCacheable(const MethodTable::Entry* entry) const {
+    return responseCache_ != nullptr && entry != nullptr && entry->procedureReturn != nullptr &&
+           entry->procedureReturn->cacheTtl().count() > 0;
+}
+
+std::string RpcServer::callKey(const MethodTable::Entry* entry, const mudong::json::Value& request) const {
+    std::string key;
+    auto params = request.findMember("params");
+    ResponseCache::makeKey(methodIndex(entry), params != request.endMember() ? &params->value : nullptr, key);
+    return key;
+}
+
+void RpcServer::handleMethodIds(mudong::json::Value& request, const RpcDoneCallback& done) {
+    if (hasParams(request)) {
+        throw RequestException(RpcError(ERROR::RPC_INVALID_PARAMS), request["id"], "rpc.methods takes no params");
+    }
+    mudong::json::Value response(mudong::json::ValueType::TYPE_OBJECT);
+    response.addMember("jsonrpc", "2.0");
+    response.addMember("id", request["id"]);
+    response.addMember("result", methodIds_);
+    done(response);
 }
 
 // 确认request合法
@@ -228,13 +681,24 @@ void RpcServer::validateRequest(mudong::json::Value& request) {
         throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), id, "jsonrpc version must be 2.0");
     }
 
-    auto& method = findValue<mudong::json::ValueType::TYPE_STRING>(request, id, "method");
-    if (method.getStringView() == "rpc.") {
+    auto& method = findValue<mudong::json::ValueType::TYPE_STRING,
+                             mudong::json::ValueType::TYPE_INT32>(request, id, "method");
+    if (method.isString() && method.getStringView() == "rpc.") {
         throw RequestException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), id, "method name is internal use");
     }
 
     size_t nMembers = 3u + hasParams(request);
 
+    // 可选的timeout字段，单位毫秒，从server收到请求时开始计算，不依赖两端时钟同步
+    if (hasTimeout(request)) {
+        auto& timeout = findValue<mudong::json::ValueType::TYPE_INT32,
+                                  mudong::json::ValueType::TYPE_INT64>(request, id, "timeout");
+        if (getInteger(timeout) < 0) {
+            throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), id, "timeout must not be negative");
+        }
+        ++nMembers;
+    }
+
     if (request.getSize() != nMembers) {
         throw RequestException(RpcError(ERROR::RPC_INVALID_REQUEST), id, "unexpected field");
     }
@@ -247,8 +711,9 @@ void RpcServer::validateNotify(mudong::json::Value& request) {
         throw NotifyException(RpcError(ERROR::RPC_INVALID_REQUEST), "jsonrpc version must be 2.0");
     }
 
-    auto& method = findValue<mudong::json::ValueType::TYPE_STRING>(request, "method");
-    if (method.getStringView() == "rpc.") {
+    auto& method = findValue<mudong::json::ValueType::TYPE_STRING,
+                             mudong::json::ValueType::TYPE_INT32>(request, "method");
+    if (method.isString() && method.getStringView() == "rpc.") {
         throw NotifyException(RpcError(ERROR::RPC_METHOD_NOT_FOUND), "method name is internal use");
     }
 
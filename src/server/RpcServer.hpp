@@ -1,12 +1,19 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <mudong-json/include/Value.hpp>
 
 #include "utils/util.hpp"
 #include "server/RpcService.hpp"
+#include "server/MethodTable.hpp"
+#include "server/Executor.hpp"
+#include "server/ConcurrencyLimiter.hpp"
+#include "server/ResponseCache.hpp"
+#include "server/SingleFlight.hpp"
 #include "server/BaseServer.hpp"
 
 namespace mudong {
@@ -20,17 +27,98 @@ public:
     RpcServer(EventLoop* loop, const InetAddress& listen)
             : BaseServer(loop, listen)
     {}
+    RpcServer(EventLoop* loop, const UnixAddress& listen)
+            : BaseServer(loop, listen)
+    {}
     ~RpcServer() = default;
 
-    // called by user stub
+    // called by user stub，须在start之前调用
     void addService(std::string_view serviceName, RpcService* service);
+
+    // 默认线程池的线程数，0表示CPU核数；需在start和第一次调用executor()之前调用
+    void setNumWorkerThread(size_t n) {
+        numWorkerThread_ = n;
+    }
+
+    /* batch中的元素个数不少于n时，切分后投递到默认线程池并发校验，inline的方法仍回到IO线程执行；0表示总是在IO线程中顺序分发。
+    只在有"pool"方法（默认线程池因此已创建）时生效，不会为此单独创建线程池；需在start之前调用
+     */
+    void setBatchParallelThreshold(size_t n) {
+        batchParallelThreshold_ = n;
+    }
+
+    /* 准入控制，需在start之前调用。同时执行的请求超过maxInFlight时最多再排队maxQueued个，
+    更多的请求立即以SERVER_OVERLOADED错误回复；请求先通过所属方法的限制，再通过全局限制。
+    notify没有响应，不计入限制
+     */
+    void setConcurrencyLimit(size_t maxInFlight, size_t maxQueued);
+    void setMethodConcurrencyLimit(std::string_view method, size_t maxInFlight, size_t maxQueued);
+
+    // spec.json中声明为cacheable的方法的结果缓存的条目数上限，0表示不缓存；没有cacheable方法时不创建缓存。需在start之前调用
+    void setResponseCacheCapacity(size_t n) {
+        responseCacheCapacity_ = n;
+    }
+
+    // 添加一个具名线程池，spec.json中"executor"为该名字的procedure在其中执行；需在start之前调用
+    void addExecutor(std::string_view name, size_t numThreads);
+
+    // 构建方法表、绑定executor后再开始监听
+    void start();
+
+    // 默认线程池，有"pool"方法时在start中创建，否则在第一次调用时才创建；可在任意线程调用，用户代码也可以向其投递任务，不必再自建线程池
+    Executor& executor();
+
+    // start之后只读，可在任意线程无锁访问
+    const MethodTable& methodTable() const {
+        return methodTable_;
+    }
+
     // called by connection manager
-    void handleRequest(const std::string& json, const RpcDoneCallback& done);
+    // request已由连接层按帧中的codec解码，flow为连接的流量控制，供流式返回的procedure使用；
+    // upload为连接层为流式上传的调用登记的接收端，供流式上传的procedure使用；
+    // loop为连接的IO线程，准入排队的请求轮到时投递回该线程执行，为nullptr时在归还名额的线程中执行
+    void handleRequest(mudong::json::Value& request, const RpcDoneCallback& done, const FlowControlPtr& flow = nullptr,
+                       const StreamReaderPtr& upload = nullptr, EventLoop* loop = nullptr);
+
+    // 连接层据此决定同一次读到的请求的分发顺序，batch和未知方法都按INTERACTIVE处理
+    Priority requestPriority(const mudong::json::Value& request) const;
+
+    // 连接层据此在读到打开调用的请求时立即登记StreamReader，之后的上传消息才能找到它
+    bool isUploadRequest(const mudong::json::Value& request) const;
+
+    // 连接层在分发单个请求之前先查缓存，命中时直接以预先序列化的result回复；请求不合法时与handleRequest一样抛出异常
+    CachedResultPtr findCachedResult(mudong::json::Value& request);
 
 private:
-    void handleSingleRequest(mudong::json::Value& request, const RpcDoneCallback& done);
-    void handleBatchRequests(mudong::json::Value& request, const RpcDoneCallback& done);
+    Executor* resolveExecutor(std::string_view name);
+
+    void handleSingleRequest(mudong::json::Value& request, const RpcDoneCallback& done, SteadyClock::time_point received,
+                             const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop);
+    const MethodTable::Entry* resolveRequest(mudong::json::Value& request, const RpcDoneCallback& done,
+                                             const FlowControlPtr& flow, const StreamReaderPtr& upload);
+    void dispatchRequest(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& done,
+                         SteadyClock::time_point received, const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop);
+    void handleBatchRequests(mudong::json::Value& request, const RpcDoneCallback& done, SteadyClock::time_point received, EventLoop* loop);
     void handleSingleNotify(mudong::json::Value& request);
+    void invokeAdmitted(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& done, Deadline deadline,
+                        const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop, int level);
+    void invokeCoalesced(const MethodTable::Entry* entry, mudong::json::Value& request, const RpcDoneCallback& reply,
+                         const RpcDoneCallback& done, const std::string& key, Deadline deadline,
+                         const FlowControlPtr& flow, const StreamReaderPtr& upload, EventLoop* loop);
+    template <typename Responses>
+    void dispatchBatch(mudong::json::Value& requests, size_t begin, size_t end, size_t slot, const Responses& responses,
+                       SteadyClock::time_point received, EventLoop* loop);
+    void dispatchBatchNotify(mudong::json::Value& request);
+
+    const MethodTable::Entry* findMethod(const mudong::json::Value& method) const;
+    const MethodTable::Entry* peekMethod(const mudong::json::Value& request) const;
+    size_t methodIndex(const MethodTable::Entry* entry) const {
+        return static_cast<size_t>(entry - methodTable_.entries().data());
+    }
+    bool isCacheable(const MethodTable::Entry* entry) const;
+    // 方法id加规范化后的params，同时用作结果缓存和合并调用的key
+    std::string callKey(const MethodTable::Entry* entry, const mudong::json::Value& request) const;
+    void handleMethodIds(mudong::json::Value& request, const RpcDoneCallback& done);
 
     void validateRequest(mudong::json::Value& request);
     void validateNotify(mudong::json::Value& request);
@@ -41,6 +129,35 @@ private:
 
     // RpcServer管理RpcService，RpcService管理Procedure
     ServiceList services_;
+    MethodTable methodTable_; // 由services_构建的扁平方法表，请求分发只查这一张表
+    mudong::json::Value methodIds_; // 方法名 -> 数字id，start时生成，作为rpc.methods的result
+    bool hasBulkMethods_ = false;   // 没有BULK方法时无需为请求查表判断延迟等级
+    bool hasUploadMethods_ = false; // 同上，没有upload方法时无需查表
+
+    // 整个server共用的线程池，替代各个service自建的线程池，统一控制CPU的使用；先于services_析构，保证任务执行完毕。
+    // 全部方法都是inline时不需要它，由executor()按需创建
+    size_t numWorkerThread_ = 0;
+    std::once_flag executorOnce_;
+    std::unique_ptr<Executor> executor_;
+    Executor* batchExecutor_ = nullptr; // 并发分发batch所用的线程池，start时确定，之后IO线程只读
+    std::unordered_map<std::string, std::unique_ptr<Executor>> namedExecutors_;
+
+    struct ConcurrencyLimit {
+        size_t maxInFlight;
+        size_t maxQueued;
+    };
+    using ConcurrencyLimiterPtr = std::unique_ptr<ConcurrencyLimiter>;
+
+    ConcurrencyLimiterPtr globalLimiter_;
+    std::unordered_map<std::string, ConcurrencyLimit> methodLimits_; // start时转换为methodLimiters_
+    std::vector<ConcurrencyLimiterPtr> methodLimiters_; // 以方法id为下标，无限制的为nullptr
+
+    size_t responseCacheCapacity_ = 4096;
+    std::unique_ptr<ResponseCache> responseCache_;
+    std::unique_ptr<SingleFlight> singleFlight_; // 有coalesce方法时才创建
+
+    static const size_t kMinBatchChunk = 8; // 并发分发batch时每段至少包含的元素个数
+    size_t batchParallelThreshold_ = 32;
 }; // class RpcServer
 
 } // namespace rpc
@@ -11,19 +11,42 @@ namespace rpc {
 class RpcService: noncopyable {
 
 public:
-    void addProcedureReturn(std::string_view methodName, ProcedureReturn* p) {
+    // executor为procedure的执行位置，见server/Procedure.hpp；priority为延迟等级，见server/Executor.hpp；
+    // cacheTtl不为0时结果按params缓存，见server/ResponseCache.hpp；coalesce为true时合并相同的并发调用，见server/SingleFlight.hpp；
+    // stream为true时分块返回结果，不能与缓存和合并同时使用
+    void addProcedureReturn(std::string_view methodName, ProcedureReturn* p, std::string_view executor = kInlineExecutor,
+                            Priority priority = Priority::INTERACTIVE, std::chrono::milliseconds cacheTtl = std::chrono::milliseconds(0),
+                            bool coalesce = false, bool stream = false, bool upload = false) {
         assert(procedureReturn_.find(methodName) == procedureReturn_.end()); //添加新的ProcedureReturn，一定是之前没有的
+        assert(!stream || (cacheTtl.count() == 0 && !coalesce));
+        assert(!upload || (cacheTtl.count() == 0 && !coalesce && !stream));
+        p->setExecutorName(executor);
+        p->setPriority(priority);
+        p->setCacheTtl(cacheTtl);
+        p->setCoalesce(coalesce);
+        p->setStream(stream);
+        p->setUpload(upload);
         procedureReturn_.emplace(methodName, p);
     }
 
-    void addProcedureNotify(std::string_view methodName, ProcedureNotify* p) {
+    void addProcedureNotify(std::string_view methodName, ProcedureNotify* p, std::string_view executor = kInlineExecutor,
+                            Priority priority = Priority::INTERACTIVE) {
         assert(procedureNotify_.find(methodName) == procedureNotify_.end()); //同上
+        p->setExecutorName(executor);
+        p->setPriority(priority);
         procedureNotify_.emplace(methodName, p);
     }
 
     void callProcedureReturn(std::string_view methodName, mudong::json::Value& request, const RpcDoneCallback& done);
     void callProcedureNotify(std::string_view methodName, mudong::json::Value& request); // notify无需callback，无返回
 
+    // 供RpcServer构建MethodTable时遍历
+    template<typename Func>
+    void forEachProcedure(Func&& func) const {
+        for (auto& [name, p] : procedureReturn_) func(name, p.get());
+        for (auto& [name, p] : procedureNotify_) func(name, p.get());
+    }
+
 private:
     using ProcedureReturnPtr = std::unique_ptr<ProcedureReturn>;
     using ProcedureNotifyPtr = std::unique_ptr<ProcedureNotify>;
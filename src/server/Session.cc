@@ -0,0 +1,244 @@
+#include <algorithm>
+
+#include "server/Session.hpp"
+#include "server/StreamReader.hpp"
+
+using namespace mudong::rpc;
+
+Session::Session(const TcpConnectionPtr& conn, const WriteCoalescing& coalescing)
+        : conn_(conn),
+          loop_(conn->getLoop()),
+          coalescing_(coalescing),
+          flushScheduled_(false),
+          closed_(false)
+{}
+
+void Session::close() {
+    loop_->assertInLoopThread();
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        callbacks.swap(writableCallbacks_);
+    }
+    // callbacks在锁外析构，其中持有的done可能在析构时回到Session
+    callbacks.clear();
+
+    for (auto& [id, reader] : uploads_) {
+        reader->close();
+    }
+    uploads_.clear();
+
+    if (shm_ != nullptr) {
+        shm_->close();
+    }
+}
+
+void Session::blockRead(ReadBlocker reason) {
+    loop_->assertInLoopThread();
+    bool wasReading = readBlockers_ == 0;
+    readBlockers_ |= reason;
+    if (!wasReading) return;
+
+    if (shm_ != nullptr) {
+        shm_->stopRead();
+    }
+    else if (auto conn = conn_.lock()) {
+        conn->stopRead();
+    }
+}
+
+void Session::unblockRead(ReadBlocker reason) {
+    loop_->assertInLoopThread();
+    if (readBlockers_ == 0) return;
+    readBlockers_ &= ~static_cast<unsigned>(reason);
+    if (readBlockers_ != 0) return;
+
+    // 请求或上传可能在连接断开之后才完成，此时不能再恢复读
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+    }
+    auto conn = conn_.lock();
+    if (conn == nullptr || !conn->connected()) return;
+
+    if (shm_ != nullptr) {
+        shm_->startRead();
+    }
+    else {
+        conn->startRead();
+    }
+}
+
+bool Session::addUpload(const StreamReaderPtr& reader) {
+    loop_->assertInLoopThread();
+    return uploads_.emplace(reader->id(), reader).second;
+}
+
+StreamReaderPtr Session::findUpload(int64_t id) const {
+    auto it = uploads_.find(id);
+    return it != uploads_.end() ? it->second : nullptr;
+}
+
+// 同一个id可能已被新的上传占用，只移除reader自己
+void Session::removeUpload(int64_t id, const StreamReader* reader) {
+    auto it = uploads_.find(id);
+    if (it != uploads_.end() && it->second.get() == reader) {
+        uploads_.erase(it);
+    }
+}
+
+bool Session::addTopic(const std::string& topic) {
+    if (hasTopic(topic)) {
+        return false;
+    }
+    topics_.push_back(topic);
+    return true;
+}
+
+bool Session::hasTopic(const std::string& topic) const {
+    return std::find(topics_.begin(), topics_.end(), topic) != topics_.end();
+}
+
+bool Session::removeTopic(const std::string& topic) {
+    auto it = std::find(topics_.begin(), topics_.end(), topic);
+    if (it == topics_.end()) {
+        return false;
+    }
+    topics_.erase(it);
+    return true;
+}
+
+void Session::setUploadBlocked(bool blocked) {
+    loop_->assertInLoopThread();
+    if (blocked) {
+        if (blockedUploads_++ == 0) blockRead(kBlockedByUpload);
+    }
+    else {
+        assert(blockedUploads_ > 0);
+        if (--blockedUploads_ == 0) unblockRead(kBlockedByUpload);
+    }
+}
+
+void Session::setOutputBlocked(bool blocked) {
+    loop_->assertInLoopThread();
+    outputBlocked_.store(blocked, std::memory_order_release);
+    if (!blocked) {
+        notifyWritable();
+    }
+}
+
+bool Session::writable() const {
+    std::lock_guard lock(mutex_);
+    return writableLocked();
+}
+
+bool Session::writableLocked() const {
+    return !outputBlocked_.load(std::memory_order_acquire) && pending_.size() < coalescing_.maxBytes;
+}
+
+void Session::whenWritable(std::function<void()> callback) {
+    {
+        // 与notifyWritable在同一把锁下判断，不会错过恢复可写的时机
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        if (!writableLocked()) {
+            writableCallbacks_.push_back(std::move(callback));
+            return;
+        }
+    }
+    loop_->queueInLoop(std::move(callback));
+}
+
+// 只在IO线程中调用，flush和输出缓冲降到高水位以下之后检查一次
+void Session::notifyWritable() {
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard lock(mutex_);
+        if (writableCallbacks_.empty() || !writableLocked()) return;
+        callbacks.swap(writableCallbacks_);
+    }
+    for (auto& callback : callbacks) {
+        callback();
+    }
+}
+
+void Session::send(std::string&& message) {
+    bool schedule = false;
+    bool full = false;
+    {
+        std::lock_guard lock(mutex_);
+        if (pending_.empty()) {
+            pending_.swap(message); // 最常见的情况只有一个响应，直接接管其内存，不做拷贝
+        }
+        else {
+            pending_.append(message);
+        }
+        full = pending_.size() >= coalescing_.maxBytes;
+        if (!flushScheduled_) {
+            flushScheduled_ = true;
+            schedule = true;
+        }
+    }
+    afterEnqueue(schedule, full);
+}
+
+void Session::send(std::string_view message) {
+    bool schedule = false;
+    bool full = false;
+    {
+        std::lock_guard lock(mutex_);
+        pending_.append(message);
+        full = pending_.size() >= coalescing_.maxBytes;
+        if (!flushScheduled_) {
+            flushScheduled_ = true;
+            schedule = true;
+        }
+    }
+    afterEnqueue(schedule, full);
+}
+
+void Session::afterEnqueue(bool schedule, bool full) {
+    if (full && loop_->isInLoopThread()) {
+        flush();
+    }
+    else if (schedule || full) {
+        scheduleFlush(full); // 已满时即使已有延迟flush在等待，也要尽快发送
+    }
+}
+
+void Session::scheduleFlush(bool immediately) {
+    std::weak_ptr<Session> weakSelf = weak_from_this();
+    auto task = [weakSelf]() {
+        if (auto self = weakSelf.lock()) {
+            self->flush();
+        }
+    };
+
+    // queueInLoop中的任务在本轮事件处理结束后才执行，在此之前到达的响应都会被合并到同一次send中；
+    // 跨线程时也只需为这一批响应唤醒一次IO线程
+    if (immediately || coalescing_.maxDelay.count() == 0) {
+        loop_->queueInLoop(task);
+    }
+    else {
+        loop_->runAfter(coalescing_.maxDelay, task);
+    }
+}
+
+void Session::flush() {
+    {
+        std::lock_guard lock(mutex_);
+        sending_.swap(pending_);
+        flushScheduled_ = false;
+    }
+    if (sending_.empty()) return;
+
+    if (shm_ != nullptr) {
+        shm_->send(sending_);
+    }
+    else if (auto conn = conn_.lock()) {
+        conn->send(sending_);
+    }
+    sending_.clear(); // 保留capacity，下一轮与pending_交换后继续复用
+    notifyWritable();
+}
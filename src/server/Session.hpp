@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/util.hpp"
+#include "shm/ShmTransport.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+// 响应合并发送的参数：待发送数据达到maxBytes时立即flush，否则最多延迟maxDelay，为0时在本轮事件循环末尾flush
+struct WriteCoalescing {
+    size_t maxBytes;
+    std::chrono::nanoseconds maxDelay;
+};
+
+// 暂停读的原因，任一原因存在时都不再读取该连接上的请求
+enum ReadBlocker : unsigned {
+    kBlockedByOutput = 0x01,   // 待发送的数据超过了高水位
+    kBlockedByInFlight = 0x02, // 未完成的请求达到了上限
+    kBlockedByUpload = 0x04,   // 有客户端流式上传缓存的数据超过了接收窗口
+};
+
+// 服务端每个连接对应一个Session，保存连接级别的状态，随连接建立而创建
+class Session : noncopyable,
+                public FlowControl,
+                public std::enable_shared_from_this<Session> {
+
+public:
+    Session(const TcpConnectionPtr& conn, const WriteCoalescing& coalescing);
+
+    EventLoop* loop() const {
+        return loop_;
+    }
+
+    // 只能在IO线程调用，连接断开时调用：关闭共享内存传输和进行中的上传，丢弃等待可写的callback。
+    // 这些callback通常经由done持有Session本身，不丢弃会形成循环引用
+    void close();
+
+    // 可在任意线程调用。message为一个或多个完整的帧，同一轮事件循环内产生的响应会被合并，只调用一次send，即一次write系统调用
+    void send(std::string&& message);
+    // 同一条消息发给多个连接时使用，直接追加到待发送的数据中
+    void send(std::string_view message);
+
+    // 只能在连接所属的IO线程调用，立即发送所有待发送的数据
+    void flush();
+
+    // 连接建立了共享内存传输时，响应改为写入共享内存，连接本身只用于感知断开
+    void setShmTransport(const ShmTransportPtr& shm) {
+        shm_ = shm;
+    }
+
+    // 对端在帧中声明过能够解压之后，发给它的帧才允许压缩，见codec/Frame.hpp
+    void setPeerAcceptsCompression() {
+        peerAcceptsCompression_.store(true, std::memory_order_relaxed);
+    }
+
+    bool peerAcceptsCompression() const {
+        return peerAcceptsCompression_.load(std::memory_order_relaxed);
+    }
+
+    // 只能在IO线程调用，第一个原因出现时暂停读，最后一个原因消失时恢复读；共享内存连接暂停的是共享内存中的读取
+    void blockRead(ReadBlocker reason);
+    void unblockRead(ReadBlocker reason);
+
+    bool readBlocked(ReadBlocker reason) const {
+        return (readBlockers_ & reason) != 0;
+    }
+
+    // 只能在IO线程调用，连接的输出缓冲超过高水位时置为true，全部发出后置为false
+    void setOutputBlocked(bool blocked);
+
+    // 流式响应的流量控制：输出缓冲未超过高水位、且尚未交给连接的数据不足一次合并发送的上限时可写
+    bool writable() const override;
+    void whenWritable(std::function<void()> callback) override;
+
+    // 客户端流式上传，按调用id查找接收端，只能在IO线程调用；id已有进行中的上传时不替换，返回false
+    bool addUpload(const StreamReaderPtr& reader);
+    size_t numUploads() const {
+        return uploads_.size();
+    }
+    StreamReaderPtr findUpload(int64_t id) const;
+    void removeUpload(int64_t id, const StreamReader* reader);
+
+    // 本连接订阅的topic，连接断开时据此退订，见server/PubSub.hpp；只能在IO线程调用，返回false表示已经订阅过/没有订阅
+    bool addTopic(const std::string& topic);
+    bool removeTopic(const std::string& topic);
+    bool hasTopic(const std::string& topic) const;
+    const std::vector<std::string>& topics() const {
+        return topics_;
+    }
+
+    // 只能在IO线程调用，任一上传超过接收窗口时暂停读，全部降回窗口之内后恢复
+    void setUploadBlocked(bool blocked);
+
+    // 已开始处理、尚未完成的请求数，返回变化后的值；完成可能发生在worker线程
+    size_t addInFlight() {
+        return inFlight_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    size_t removeInFlight() {
+        return inFlight_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+    size_t inFlight() const {
+        return inFlight_.load(std::memory_order_acquire);
+    }
+
+    // 推送是否正因输出缓冲已满而被跳过，publish可在任意线程调用；返回状态是否发生了变化，只在变化时记录日志
+    bool setPublishSkipped(bool skipped) {
+        if (publishSkipped_.load(std::memory_order_relaxed) == skipped) return false;
+        return publishSkipped_.exchange(skipped, std::memory_order_relaxed) != skipped;
+    }
+
+    // 只在IO线程中使用，避免为同一个连接重复投递继续处理剩余请求的任务
+    void setResumeScheduled(bool on) {
+        resumeScheduled_ = on;
+    }
+    bool resumeScheduled() const {
+        return resumeScheduled_;
+    }
+
+private:
+    void afterEnqueue(bool schedule, bool full);
+    void scheduleFlush(bool immediately);
+    bool writableLocked() const;
+    void notifyWritable();
+
+    std::weak_ptr<TcpConnection> conn_; // 连接的回调持有Session，这里用weak_ptr避免循环引用
+    ShmTransportPtr shm_;               // shm_的回调同样持有Session，连接断开时由ShmTransport::close()解除
+    EventLoop* loop_;
+    const WriteCoalescing coalescing_;
+
+    mutable std::mutex mutex_;
+    std::string pending_;     // 待发送的帧，guarded by mutex_
+    bool flushScheduled_;     // 是否已有flush任务在等待执行，guarded by mutex_
+    std::string sending_;     // 只在IO线程中使用，与pending_交换以复用内存
+    std::vector<std::function<void()>> writableCallbacks_; // 等待可写的流式响应，guarded by mutex_
+    bool closed_;             // guarded by mutex_
+    std::atomic<bool> outputBlocked_{false};
+
+    std::atomic<bool> peerAcceptsCompression_{false}; // IO线程中写入，响应可能在worker线程中编码，因此为atomic
+
+    unsigned readBlockers_ = 0;        // ReadBlocker的组合，只在IO线程中使用
+    std::unordered_map<int64_t, StreamReaderPtr> uploads_; // 进行中的上传，只在IO线程中使用
+    size_t blockedUploads_ = 0;        // 超过接收窗口的上传数，只在IO线程中使用
+    std::vector<std::string> topics_;  // 只在IO线程中使用，数量有上限（见BaseServer::handleSubscription），顺序查找即可
+    bool resumeScheduled_ = false;
+    std::atomic<size_t> inFlight_{0};
+    std::atomic<bool> publishSkipped_{false};
+}; // class Session
+
+using SessionPtr = std::shared_ptr<Session>;
+
+} // namespace rpc
+
+} // namespace mudong
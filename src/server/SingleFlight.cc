@@ -0,0 +1,66 @@
+#include "server/SingleFlight.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+// response为浅拷贝，只替换id，result或error与其他调用共享
+mudong::json::Value withId(const mudong::json::Value& response, const mudong::json::Value& id) {
+    mudong::json::Value copy(mudong::json::ValueType::TYPE_OBJECT);
+    for (auto it = response.beginMember(); it != response.endMember(); ++it) {
+        auto& value = it->key.getStringView() == "id" ? id : it->value;
+        copy.addMember(mudong::json::Value(it->key), mudong::json::Value(value));
+    }
+    return copy;
+}
+
+bool isExpired(Deadline deadline) {
+    return deadline != kNoDeadline && SteadyClock::now() >= deadline;
+}
+
+} // anonymous namespace
+
+bool SingleFlight::join(const std::string& key, const mudong::json::Value& id, const RpcDoneCallback& done,
+                       Deadline deadline, const Redispatch& redispatch) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto [it, inserted] = flights_.try_emplace(key);
+    if (!inserted) {
+        it->second.push_back(Waiter{id, done, deadline, redispatch});
+    }
+    return inserted;
+}
+
+void SingleFlight::finish(const std::string& key, const mudong::json::Value& response) {
+    // 在锁外回复，done可能同步地再次进入join
+    for (auto& waiter : take(key)) {
+        if (isExpired(waiter.deadline)) {
+            waiter.done(errorResponse(waiter.id, RpcError(ERROR::RPC_REQUEST_TIMEOUT), "deadline exceeded while coalesced"));
+        }
+        else {
+            waiter.done(withId(response, waiter.id));
+        }
+    }
+}
+
+void SingleFlight::abandon(const std::string& key) {
+    for (auto& waiter : take(key)) {
+        if (isExpired(waiter.deadline)) {
+            waiter.done(errorResponse(waiter.id, RpcError(ERROR::RPC_REQUEST_TIMEOUT), "deadline exceeded while coalesced"));
+        }
+        else {
+            waiter.redispatch();
+        }
+    }
+}
+
+std::vector<SingleFlight::Waiter> SingleFlight::take(const std::string& key) {
+    std::vector<Waiter> waiters;
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = flights_.find(key);
+    // key不存在说明这次调用已经结束过
+    if (it != flights_.end()) {
+        waiters.swap(it->second);
+        flights_.erase(it);
+    }
+    return waiters;
+}
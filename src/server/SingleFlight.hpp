@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <mudong-json/include/Value.hpp>
+
+#include "utils/util.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 合并相同的并发调用：同一个key（方法加规范化后的params，见ResponseCache::makeKey）已有调用在执行时，
+之后到达的调用不再执行procedure，挂起等待；执行中的调用完成时，以同一个response依次回复所有挂起的调用，
+各自换上自己请求中的id。用于保护昂贵的后端，避免缓存失效时大量相同的请求同时击穿。
+只共享procedure产生的结果：执行者超时或过载时没有可共享的结果，挂起的调用各自重新分发
+ */
+class SingleFlight : noncopyable {
+
+public:
+    using Redispatch = std::function<void()>;
+
+    // 没有相同key的调用在执行时返回true，调用者负责执行，完成后须调用finish或abandon；
+    // 否则done被挂起，返回false。redispatch用于执行者没有结果时重新分发该调用
+    bool join(const std::string& key, const mudong::json::Value& id, const RpcDoneCallback& done,
+              Deadline deadline, const Redispatch& redispatch);
+
+    // 以执行者的response回复所有挂起的调用，之后到达的相同调用将重新执行；key不存在时（已经结束过）什么也不做
+    void finish(const std::string& key, const mudong::json::Value& response);
+
+    // 执行者没有得到procedure的结果（超时或过载），挂起的调用各自重新分发，其中第一个成为新的执行者；
+    // key不存在时什么也不做
+    void abandon(const std::string& key);
+
+private:
+    struct Waiter {
+        mudong::json::Value id;
+        RpcDoneCallback done;
+        Deadline deadline;
+        Redispatch redispatch;
+    };
+
+    std::vector<Waiter> take(const std::string& key);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<Waiter>> flights_; // 执行中的key -> 挂起的调用，guarded by mutex_
+}; // class SingleFlight
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,118 @@
+#include "server/StreamReader.hpp"
+
+using namespace mudong::rpc;
+
+StreamReader::StreamReader(const SessionPtr& session, int64_t id, size_t window)
+        : session_(session),
+          loop_(session->loop()),
+          id_(id),
+          window_(window)
+{}
+
+void StreamReader::start(ChunkHandler onChunk, std::function<void()> onEnd) {
+    {
+        std::lock_guard lock(mutex_);
+        assert(!started_);
+        if (closed_) return;
+        onChunk_ = std::move(onChunk);
+        onEnd_ = std::move(onEnd);
+        started_ = true;
+    }
+    loop_->queueInLoop([self = shared_from_this()]() { self->drain(); });
+}
+
+void StreamReader::pause() {
+    std::lock_guard lock(mutex_);
+    paused_ = true;
+}
+
+void StreamReader::resume() {
+    {
+        std::lock_guard lock(mutex_);
+        if (!paused_) return;
+        paused_ = false;
+    }
+    loop_->queueInLoop([self = shared_from_this()]() { self->drain(); });
+}
+
+void StreamReader::push(mudong::json::Value& chunk, size_t bytes) {
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        buffered_.push_back(Chunk{chunk, bytes});
+        bufferedBytes_ += bytes;
+    }
+    drain();
+}
+
+void StreamReader::finish() {
+    {
+        std::lock_guard lock(mutex_);
+        ended_ = true;
+    }
+    drain();
+}
+
+void StreamReader::close() {
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        closed_ = true;
+        buffered_.clear();
+        bufferedBytes_ = 0;
+    }
+    // callback可能正在IO线程中执行（如在onChunk中直接回复），总是推迟到IO线程中清除
+    loop_->queueInLoop([self = shared_from_this()]() { self->detach(); });
+}
+
+// 只在IO线程中调用，callback在锁外执行，其中可以再调用pause/resume/close
+void StreamReader::drain() {
+    for (;;) {
+        mudong::json::Value chunk;
+        bool end = false;
+        {
+            std::lock_guard lock(mutex_);
+            if (closed_ || paused_ || !started_) break;
+            if (buffered_.empty()) {
+                if (!ended_ || endDelivered_) break;
+                endDelivered_ = true;
+                end = true;
+            }
+            else {
+                chunk = std::move(buffered_.front().value);
+                bufferedBytes_ -= buffered_.front().bytes;
+                buffered_.pop_front();
+            }
+        }
+        if (end) {
+            if (onEnd_) onEnd_();
+            break;
+        }
+        onChunk_(chunk);
+    }
+    updateWindow();
+}
+
+void StreamReader::detach() {
+    onChunk_ = nullptr;
+    onEnd_ = nullptr;
+    updateWindow();
+    if (auto session = session_.lock()) {
+        session->removeUpload(id_, this);
+    }
+}
+
+// 超过窗口时暂停读，降到一半以下才恢复，避免在窗口边缘反复切换
+void StreamReader::updateWindow() {
+    size_t bytes;
+    {
+        std::lock_guard lock(mutex_);
+        bytes = bufferedBytes_;
+    }
+    bool blocking = blocking_ ? bytes > window_ / 2 : bytes > window_;
+    if (blocking == blocking_) return;
+    blocking_ = blocking;
+    if (auto session = session_.lock()) {
+        session->setUploadBlocked(blocking);
+    }
+}
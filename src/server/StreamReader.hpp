@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <mudong-json/include/Value.hpp>
+
+#include "utils/util.hpp"
+#include "server/Session.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 客户端流式上传：client先发出一个普通的请求打开调用，之后以同一个id逐块发送数据，最后发送结束消息
+{"jsonrpc":"2.0","id":...,"stream":chunk}
+{"jsonrpc":"2.0","id":...,"end":true}
+spec.json中声明为upload的procedure通过StreamReader在块到达时逐块处理，不必等整个参数收齐、也不必整体解析。
+procedure开始接收之前或暂停期间到达的块缓存在这里，超过接收窗口时暂停读该连接，降到窗口一半以下时恢复，
+服务端为一次上传占用的内存因此有界
+ */
+class StreamReader : noncopyable,
+                     public std::enable_shared_from_this<StreamReader> {
+
+public:
+    using ChunkHandler = std::function<void(mudong::json::Value& chunk)>;
+
+    StreamReader(const SessionPtr& session, int64_t id, size_t window);
+
+    // 以下可在任意线程调用，callback都在连接的IO线程中按到达顺序执行。
+    // 开始接收，之前已到达的块依次交付；onEnd在最后一块交付之后执行，调用已经回复时不再执行
+    void start(ChunkHandler onChunk, std::function<void()> onEnd);
+    // 暂停交付，之后到达的块缓存起来；耗时的处理投递到线程池之前暂停，处理完后恢复，未处理的块就不会无限堆积
+    void pause();
+    void resume();
+
+    // 以下由连接层在IO线程中调用，bytes为该块所在帧的大小，用于计算接收窗口
+    void push(mudong::json::Value& chunk, size_t bytes);
+    void finish();
+
+    // 可在任意线程调用。调用已经回复或连接已断开，丢弃缓存的块和callback，之后到达的块直接丢弃
+    void close();
+
+    int64_t id() const {
+        return id_;
+    }
+
+private:
+    void drain();
+    void detach();
+    void updateWindow();
+
+    struct Chunk {
+        mudong::json::Value value;
+        size_t bytes;
+    };
+
+    std::weak_ptr<Session> session_; // Session持有StreamReader，这里用weak_ptr避免循环引用
+    EventLoop* loop_;
+    const int64_t id_;
+    const size_t window_;
+
+    std::mutex mutex_;
+    // callback只在start时写入、在IO线程中由detach清除，交付时无需持锁
+    ChunkHandler onChunk_;
+    std::function<void()> onEnd_;
+    std::deque<Chunk> buffered_; // guarded by mutex_
+    size_t bufferedBytes_ = 0;   // guarded by mutex_
+    bool started_ = false;       // guarded by mutex_
+    bool paused_ = false;        // guarded by mutex_
+    bool ended_ = false;         // guarded by mutex_
+    bool closed_ = false;        // guarded by mutex_
+    bool endDelivered_ = false;  // 只在IO线程中使用
+    bool blocking_ = false;      // 只在IO线程中使用，是否因本次上传暂停了读
+}; // class StreamReader
+
+// 上传的后续消息没有method字段，以"stream"或"end"与普通请求区分
+inline bool isUploadMessage(const mudong::json::Value& message) {
+    return message.isObject() &&
+           message.findMember("method") == message.endMember() &&
+           (message.findMember("stream") != message.endMember() || message.findMember("end") != message.endMember());
+}
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,222 @@
+#include <cerrno>
+#include <chrono>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "server/UnixServer.hpp"
+
+using namespace mudong::rpc;
+
+namespace {
+
+const int kListenBacklog = SOMAXCONN;
+const auto kHandshakeTimeout = std::chrono::seconds(1);
+
+int createListenSocket(const UnixAddress& local) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        SYSFATAL("UnixServer::socket()");
+    }
+    if (!local.isAbstract()) {
+        ::unlink(local.path().c_str()); // 清理上次进程退出时遗留的socket文件，否则bind会失败
+    }
+    if (::bind(fd, local.getSockaddr(), local.getSocklen()) == -1) {
+        SYSFATAL("UnixServer::bind() {}", local.path());
+    }
+    return fd;
+}
+
+// socket文件的inode，不存在或为abstract地址时返回0
+ino_t socketInode(const UnixAddress& local) {
+    struct stat st = {};
+    if (local.isAbstract() || ::stat(local.path().c_str(), &st) == -1) {
+        return 0;
+    }
+    return st.st_ino;
+}
+
+} // anonymous namespace
+
+UnixServer::UnixServer(EventLoop* loop, const UnixAddress& local)
+        : baseLoop_(loop),
+          local_(local),
+          dummyAddress_(0, true),
+          listenfd_(createListenSocket(local)),
+          acceptChannel_(loop, listenfd_),
+          numThreads_(1),
+          started_(false),
+          nextLoop_(0),
+          handshakeWaitsForPeer_(false)
+{
+    acceptChannel_.setReadCallback(std::bind(&UnixServer::handleAccept, this));
+    inode_ = socketInode(local_);
+}
+
+UnixServer::~UnixServer() {
+    for (auto loop : ioLoops_) {
+        if (loop != baseLoop_) {
+            loop->quit();
+        }
+    }
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    for (auto& [connfd, handshake] : handshakes_) {
+        ::close(connfd);
+    }
+    ::close(listenfd_);
+    // 重启时新进程会在同一路径上重新bind，此时的socket文件已经属于新进程，不能删除
+    if (inode_ != 0 && socketInode(local_) == inode_) {
+        ::unlink(local_.path().c_str());
+    }
+}
+
+void UnixServer::setNumThread(size_t n) {
+    baseLoop_->assertInLoopThread();
+    assert(n > 0);
+    assert(!started_);
+    numThreads_ = n;
+}
+
+void UnixServer::start() {
+    if (started_.exchange(true)) return;
+    baseLoop_->runInLoop(std::bind(&UnixServer::startInLoop, this));
+}
+
+void UnixServer::startInLoop() {
+    ioLoops_.assign(numThreads_, nullptr);
+    ioLoops_[0] = baseLoop_;
+
+    // 与TcpServer一样，IO线程各自运行一个EventLoop，全部启动完成后才开始accept
+    CountDownLatch latch(static_cast<int>(numThreads_ - 1));
+    for (size_t i = 1; i < numThreads_; ++i) {
+        threads_.emplace_back(&UnixServer::runInThread, this, i, std::ref(latch));
+    }
+    latch.wait();
+
+    if (::listen(listenfd_, kListenBacklog) == -1) {
+        SYSFATAL("UnixServer::listen() {}", local_.path());
+    }
+    acceptChannel_.enableRead();
+    INFO("UnixServer::start() listen on {}", local_.path());
+}
+
+void UnixServer::stopAccept() {
+    baseLoop_->runInLoop([this]() {
+        if (!acceptChannel_.isNoneEvents()) acceptChannel_.disableAll();
+    });
+}
+
+void UnixServer::runInThread(size_t index, CountDownLatch& latch) {
+    EventLoop loop;
+    ioLoops_[index] = &loop; // 各线程写入不同下标，latch保证startInLoop读取时已全部写完
+    latch.countDown();
+    loop.loop();
+    ioLoops_[index] = nullptr;
+}
+
+void UnixServer::handleAccept() {
+    baseLoop_->assertInLoopThread();
+
+    int connfd = ::accept4(listenfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (connfd == -1) {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+            SYSERR("UnixServer::accept4()");
+        }
+        return;
+    }
+    newConnection(connfd);
+}
+
+void UnixServer::newConnection(int connfd) {
+    auto ioLoop = nextLoop();
+    ioLoop->runInLoop(std::bind(&UnixServer::establishConnection, this, ioLoop, connfd));
+}
+
+void UnixServer::establishConnection(EventLoop* ioLoop, int connfd) {
+    if (!handshakeCallback_) {
+        createConnection(ioLoop, connfd, std::any());
+        return;
+    }
+    if (handshakeWaitsForPeer_) {
+        waitHandshake(ioLoop, connfd);
+        return;
+    }
+    auto context = handshakeCallback_(ioLoop, connfd);
+    if (!context.has_value()) {
+        ::close(connfd);
+        return;
+    }
+    createConnection(ioLoop, connfd, context);
+}
+
+// 对端的握手消息到达之前只关注connfd的可读事件，不在IO线程中阻塞等待
+void UnixServer::waitHandshake(EventLoop* ioLoop, int connfd) {
+    auto handshake = std::make_unique<PendingHandshake>(ioLoop, connfd);
+    handshake->channel.setReadCallback(std::bind(&UnixServer::finishHandshake, this, ioLoop, connfd, false));
+    handshake->timer = ioLoop->runAfter(kHandshakeTimeout, std::bind(&UnixServer::finishHandshake, this, ioLoop, connfd, true));
+    handshake->channel.enableRead();
+
+    std::lock_guard lock(mutex_);
+    handshakes_.emplace(connfd, std::move(handshake));
+}
+
+void UnixServer::finishHandshake(EventLoop* ioLoop, int connfd, bool timeout) {
+    std::shared_ptr<PendingHandshake> handshake;
+    {
+        std::lock_guard lock(mutex_);
+        auto it = handshakes_.find(connfd);
+        if (it == handshakes_.end()) return;
+        handshake = std::move(it->second);
+        handshakes_.erase(it);
+    }
+    handshake->channel.disableAll();
+    if (!timeout) {
+        ioLoop->cancelTimer(handshake->timer);
+    }
+    // 可能正在该Channel的回调中，推迟到本轮事件循环末尾析构
+    ioLoop->queueInLoop([handshake]() {});
+
+    if (timeout) {
+        WARN("UnixServer::finishHandshake() {} handshake timeout", local_.path());
+        ::close(connfd);
+        return;
+    }
+    auto context = handshakeCallback_(ioLoop, connfd);
+    if (!context.has_value()) {
+        ::close(connfd);
+        return;
+    }
+    createConnection(ioLoop, connfd, context);
+}
+
+void UnixServer::createConnection(EventLoop* ioLoop, int connfd, const std::any& context) {
+    auto conn = std::make_shared<TcpConnection>(ioLoop, connfd, dummyAddress_, dummyAddress_);
+    conn->setContext(context);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&UnixServer::closeConnection, this, _1));
+    {
+        std::lock_guard lock(mutex_);
+        connections_.insert(conn);
+    }
+
+    conn->connectEstablished();
+    connectionCallback_(conn);
+}
+
+void UnixServer::closeConnection(const TcpConnectionPtr& conn) {
+    conn->getLoop()->assertInLoopThread();
+    connectionCallback_(conn);
+
+    std::lock_guard lock(mutex_);
+    connections_.erase(conn);
+}
+
+EventLoop* UnixServer::nextLoop() {
+    auto loop = ioLoops_[nextLoop_];
+    nextLoop_ = (nextLoop_ + 1) % ioLoops_.size();
+    return loop;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <any>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <mudong-ev/src/Channel.hpp>
+
+#include "utils/util.hpp"
+#include "utils/UnixAddress.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 监听AF_UNIX流式套接字，接口与TcpServer保持一致
+同一主机上的调用不必经过TCP协议栈，也不占用临时端口。建立的连接同样是TcpConnection，
+只是底层fd为unix socket，因此上层的拆包、编解码和各类回调无需区分两种传输方式
+ */
+class UnixServer : noncopyable {
+
+public:
+    // 在IO线程中、创建TcpConnection之前调用，可在connfd上完成额外的握手，返回值作为连接的context；返回空值表示拒绝该连接
+    using HandshakeCallback = std::function<std::any(EventLoop* loop, int connfd)>;
+
+    UnixServer(EventLoop* loop, const UnixAddress& local);
+    ~UnixServer();
+
+    // 与TcpServer相同，n为处理IO的线程总数，包括loop所在的线程；这些线程归本监听地址独占，不与其他UnixServer或TcpServer共享
+    void setNumThread(size_t n);
+    void start();
+
+    // 可在任意线程调用，停止accept新连接，已建立的连接不受影响
+    void stopAccept();
+
+    void setConnectionCallback(const ConnectionCallback& cb) {
+        connectionCallback_ = cb;
+    }
+
+    void setMessageCallback(const ev::MessageCallback& cb) {
+        messageCallback_ = cb;
+    }
+
+    void setWriteCompleteCallback(const ev::WriteCompleteCallback& cb) {
+        writeCompleteCallback_ = cb;
+    }
+
+    // waitForPeer为true时，对端先发送握手消息：等connfd可读之后才调用callback，超时未收到则关闭连接。
+    // 等待期间不阻塞IO线程，其他连接照常处理
+    void setHandshakeCallback(const HandshakeCallback& cb, bool waitForPeer = false) {
+        handshakeCallback_ = cb;
+        handshakeWaitsForPeer_ = waitForPeer;
+    }
+
+private:
+    void startInLoop();
+    void runInThread(size_t index, CountDownLatch& latch);
+    void handleAccept();
+    void newConnection(int connfd);
+    void establishConnection(EventLoop* ioLoop, int connfd);
+    void waitHandshake(EventLoop* ioLoop, int connfd);
+    void finishHandshake(EventLoop* ioLoop, int connfd, bool timeout);
+    void createConnection(EventLoop* ioLoop, int connfd, const std::any& context);
+    void closeConnection(const TcpConnectionPtr& conn);
+    EventLoop* nextLoop();
+
+private:
+    EventLoop* baseLoop_;
+    const UnixAddress local_;
+    const InetAddress dummyAddress_; // TcpConnection的local和peer只能是InetAddress，unix socket没有ip和端口，以此占位
+    const int listenfd_;
+    ino_t inode_;                    // bind得到的socket文件，析构时只删除仍属于自己的文件
+    ev::Channel acceptChannel_;
+
+    size_t numThreads_;
+    std::atomic<bool> started_;
+    std::vector<std::thread> threads_;
+    std::vector<EventLoop*> ioLoops_; // 下标0为baseLoop_
+    size_t nextLoop_;                 // 轮询分配连接，只在baseLoop_中使用
+
+    std::mutex mutex_;
+    std::unordered_set<TcpConnectionPtr> connections_; // 连接在各自的IO线程中关闭，guarded by mutex_
+
+    // 等待对端握手消息的连接，按connfd索引，guarded by mutex_
+    struct PendingHandshake {
+        PendingHandshake(EventLoop* loop, int connfd)
+                : channel(loop, connfd),
+                  timer(nullptr)
+        {}
+
+        ev::Channel channel;
+        ev::Timer* timer;
+    };
+    std::unordered_map<int, std::unique_ptr<PendingHandshake>> handshakes_;
+
+    ConnectionCallback connectionCallback_;
+    ev::MessageCallback messageCallback_;
+    ev::WriteCompleteCallback writeCompleteCallback_;
+    HandshakeCallback handshakeCallback_;
+    bool handshakeWaitsForPeer_;
+}; // class UnixServer
+
+} // namespace rpc
+
+} // namespace mudong
@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm/ShmTransport.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+/* 单生产者单消费者的字节环形队列，位于共享内存中，两个进程各自映射
+读写位置单调递增，对capacity取模得到偏移，capacity为2的幂
+ */
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> writePos;
+    alignas(64) std::atomic<uint64_t> readPos;
+    alignas(64) std::atomic<uint32_t> readerSleeping; // 读端已经或即将进入epoll等待，写入后需要敲门铃
+    std::atomic<uint32_t> writerBlocked;              // 写端因队列已满而等待，读出后需要敲门铃
+    uint64_t capacity;                                // 由client初始化，仅供参考；对端可以改写，两端都只使用握手时校验过的ringSize
+
+    char* data() {
+        return reinterpret_cast<char*>(this) + sizeof(ShmRing);
+    }
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+} // namespace rpc
+
+} // namespace mudong
+
+using namespace mudong::rpc;
+
+namespace {
+
+const uint32_t kHandshakeMagic = 0x4d52534d; // "MRSM"
+const size_t kMinRingSize = 4096;
+const size_t kMaxRingSize = 1ul << 30;
+const int kHandshakeFds = 3; // 共享内存、client门铃、server门铃
+const auto kDefaultMaxSpin = std::chrono::microseconds(50);
+const auto kMinSpin = std::chrono::microseconds(1);
+
+struct Handshake {
+    uint32_t magic;
+    uint32_t ringSize;
+};
+
+size_t mapLength(size_t ringSize) {
+    return 2 * (sizeof(ShmRing) + ringSize);
+}
+
+ShmRing* ringAt(char* base, size_t ringSize, size_t index) {
+    return reinterpret_cast<ShmRing*>(base + index * (sizeof(ShmRing) + ringSize));
+}
+
+void closeFds(const int* fds, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (fds[i] != -1) ::close(fds[i]);
+    }
+}
+
+bool hasShrinkSeal(int fd) {
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    return seals != -1 && (seals & F_SEAL_SHRINK) != 0;
+}
+
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // anonymous namespace
+
+ShmTransportPtr ShmTransport::connect(EventLoop* loop, int connfd, size_t ringSize) {
+    assert(ringSize >= kMinRingSize && ringSize <= kMaxRingSize && (ringSize & (ringSize - 1)) == 0);
+
+    // fds: 共享内存、client门铃、server门铃
+    int fds[kHandshakeFds] = {
+        ::memfd_create("mudong-rpc-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING),
+        ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC),
+        ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)
+    };
+    size_t len = mapLength(ringSize);
+    // 封住大小：server映射之后client无法再截断共享内存，否则server访问队列时会收到SIGBUS
+    if (fds[0] == -1 || fds[1] == -1 || fds[2] == -1 || ::ftruncate(fds[0], static_cast<off_t>(len)) == -1 ||
+        ::fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        SYSERR("ShmTransport::connect() create shared memory");
+        closeFds(fds, kHandshakeFds);
+        return nullptr;
+    }
+
+    void* addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (addr == MAP_FAILED) {
+        SYSERR("ShmTransport::connect() mmap");
+        closeFds(fds, kHandshakeFds);
+        return nullptr;
+    }
+    auto base = static_cast<char*>(addr);
+    for (size_t i = 0; i < 2; ++i) {
+        auto ring = new (ringAt(base, ringSize, i)) ShmRing();
+        ring->capacity = ringSize;
+        ring->readerSleeping.store(1, std::memory_order_relaxed); // 对端尚未开始读，先按睡眠处理，保证第一次写入会敲门铃
+    }
+
+    Handshake handshake{kHandshakeMagic, static_cast<uint32_t>(ringSize)};
+    struct iovec iov = {&handshake, sizeof(handshake)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // 刚建立的连接发送缓冲区为空，这么小的消息总能一次发完
+    if (::sendmsg(connfd, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(handshake))) {
+        SYSERR("ShmTransport::connect() sendmsg");
+        ::munmap(addr, len);
+        closeFds(fds, kHandshakeFds);
+        return nullptr;
+    }
+    ::close(fds[0]); // 映射之后不再需要memfd，server持有自己的副本
+
+    // client写ring 0，读ring 1
+    return ShmTransportPtr(new ShmTransport(loop, base, len, ringSize,
+                                            ringAt(base, ringSize, 1), ringAt(base, ringSize, 0),
+                                            fds[1], fds[2]));
+}
+
+ShmTransportPtr ShmTransport::accept(EventLoop* loop, int connfd) {
+    // UnixServer在connfd可读之后才调用，client在connect之后一次sendmsg发出握手消息，这里不会阻塞
+    Handshake handshake{};
+    struct iovec iov = {&handshake, sizeof(handshake)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kHandshakeFds)] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = ::recvmsg(connfd, &msg, MSG_CMSG_CLOEXEC);
+    int fds[kHandshakeFds] = {-1, -1, -1};
+    // 对端发来的每个fd都已在本进程中打开，格式不符时也要全部关闭
+    bool wellFormed = true;
+    int numCmsgs = 0;
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        if (++numCmsgs == 1 && cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+            continue;
+        }
+        wellFormed = false;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            ::close(fd);
+        }
+    }
+
+    size_t ringSize = handshake.ringSize;
+    size_t len = mapLength(ringSize);
+    struct stat st = {};
+    // 只接受封住了大小的共享内存，见connect
+    if (!wellFormed || n != static_cast<ssize_t>(sizeof(handshake)) || (msg.msg_flags & MSG_CTRUNC) ||
+        fds[0] == -1 || handshake.magic != kHandshakeMagic ||
+        ringSize < kMinRingSize || ringSize > kMaxRingSize || (ringSize & (ringSize - 1)) != 0 ||
+        ::fstat(fds[0], &st) == -1 || static_cast<size_t>(st.st_size) != len ||
+        !hasShrinkSeal(fds[0])) {
+        WARN("ShmTransport::accept() bad handshake");
+        closeFds(fds, kHandshakeFds);
+        return nullptr;
+    }
+
+    void* addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    ::close(fds[0]);
+    if (addr == MAP_FAILED) {
+        SYSERR("ShmTransport::accept() mmap");
+        closeFds(fds + 1, kHandshakeFds - 1);
+        return nullptr;
+    }
+    auto base = static_cast<char*>(addr);
+
+    // server读ring 0，写ring 1
+    return ShmTransportPtr(new ShmTransport(loop, base, len, ringSize,
+                                            ringAt(base, ringSize, 0), ringAt(base, ringSize, 1),
+                                            fds[2], fds[1]));
+}
+
+ShmTransport::ShmTransport(EventLoop* loop, char* base, size_t mapLen, size_t ringSize, ShmRing* inbound, ShmRing* outbound, int doorbell, int peerDoorbell)
+        : loop_(loop),
+          base_(base),
+          mapLen_(mapLen),
+          ringSize_(ringSize),
+          inbound_(inbound),
+          outbound_(outbound),
+          doorbell_(doorbell),
+          peerDoorbell_(peerDoorbell),
+          channel_(loop, doorbell),
+          closed_(false),
+          reading_(true),
+          maxSpin_(kDefaultMaxSpin),
+          spin_(kDefaultMaxSpin),
+          highWaterMark_(64 * 1024 * 1024)
+{
+    channel_.setReadCallback(std::bind(&ShmTransport::handleDoorbell, this));
+}
+
+ShmTransport::~ShmTransport() {
+    assert(closed_ || !channel_.isReading());
+    ::munmap(base_, mapLen_);
+    ::close(doorbell_);
+    ::close(peerDoorbell_);
+}
+
+void ShmTransport::start() {
+    loop_->assertInLoopThread();
+    channel_.tie(shared_from_this());
+    channel_.enableRead();
+    pump(); // 握手完成之前对端可能已经写入了数据
+}
+
+void ShmTransport::close() {
+    loop_->assertInLoopThread();
+    if (closed_) return;
+    closed_ = true;
+    channel_.disableAll();
+    messageCallback_ = nullptr; // 回调中持有连接和Session，在此解除循环引用
+    highWaterMarkCallback_ = nullptr;
+    writeCompleteCallback_ = nullptr;
+    pending_.clear();
+}
+
+void ShmTransport::startRead() {
+    loop_->assertInLoopThread();
+    if (reading_) return;
+    reading_ = true;
+    pump(); // 暂停期间对端写入时不会敲门铃
+}
+
+void ShmTransport::send(std::string_view data) {
+    if (!loop_->isInLoopThread()) {
+        loop_->runInLoop([self = shared_from_this(), message = std::string(data)]() {
+            self->send(message);
+        });
+        return;
+    }
+    if (closed_) return;
+
+    if (!pending_.empty()) {
+        appendPending(data); // 保证顺序，前面的数据还没写完
+        return;
+    }
+    size_t n = write(data);
+    if (n < data.length()) {
+        appendPending(data.substr(n));
+        flushPending();
+    }
+}
+
+// 与TcpConnection相同，只在越过高水位的那一次回调
+void ShmTransport::appendPending(std::string_view data) {
+    size_t old = pending_.size();
+    pending_.append(data);
+    if (old < highWaterMark_ && pending_.size() >= highWaterMark_ && highWaterMarkCallback_) {
+        loop_->queueInLoop([self = shared_from_this(), size = pending_.size()]() {
+            if (self->highWaterMarkCallback_) self->highWaterMarkCallback_(size);
+        });
+    }
+}
+
+void ShmTransport::handleDoorbell() {
+    uint64_t count;
+    if (::read(doorbell_, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        SYSERR("ShmTransport::handleDoorbell() read");
+    }
+    pump();
+}
+
+// 门铃响起有两种原因：inbound_中有新数据，或对端从outbound_中读出了数据，腾出了空间
+void ShmTransport::pump() {
+    inbound_->readerSleeping.store(0, std::memory_order_relaxed); // 处理期间对端的写入无需敲门铃
+    flushPending();
+
+    if (drain()) {
+        spin();
+    }
+
+    // 先置位再检查，与写端的"先写入再检查"配对，保证不会丢失唤醒；暂停读时不置位，由startRead重新检查
+    while (!closed_ && reading_) {
+        inbound_->readerSleeping.store(1, std::memory_order_seq_cst);
+        if (inbound_->writePos.load(std::memory_order_seq_cst) == inbound_->readPos.load(std::memory_order_relaxed)) break;
+        inbound_->readerSleeping.store(0, std::memory_order_relaxed);
+        drain();
+    }
+}
+
+bool ShmTransport::drain() {
+    if (closed_ || !reading_) return false;
+
+    uint64_t r = inbound_->readPos.load(std::memory_order_relaxed);
+    uint64_t w = inbound_->writePos.load(std::memory_order_acquire);
+    if (w == r) return false;
+
+    uint64_t capacity = ringSize_;
+    if (w - r > capacity) {
+        ERROR("ShmTransport::drain() corrupted ring, readPos {} writePos {}", r, w);
+        close();
+        return false;
+    }
+
+    // 直接拷贝进Buffer的可写区域，队列回绕时分两段
+    auto n = static_cast<size_t>(w - r);
+    auto offset = static_cast<size_t>(r & (capacity - 1));
+    auto first = std::min(n, static_cast<size_t>(capacity) - offset);
+    buffer_.ensureWritableBytes(n);
+    std::memcpy(buffer_.beginWrite(), inbound_->data() + offset, first);
+    std::memcpy(buffer_.beginWrite() + first, inbound_->data(), n - first);
+    buffer_.hasWritten(n);
+    inbound_->readPos.store(w, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (inbound_->writerBlocked.load(std::memory_order_relaxed)) {
+        ringPeer();
+    }
+
+    if (messageCallback_) {
+        messageCallback_(buffer_);
+    }
+    return true;
+}
+
+// 刚收到数据时，对端往往很快还有后续数据（如同一批请求的响应），自旋等待可以省去一次epoll唤醒。
+// 自旋期间等到了数据则下次加倍，否则减半，空闲的连接几乎不会占用CPU
+void ShmTransport::spin() {
+    using Clock = std::chrono::steady_clock;
+    if (maxSpin_.count() == 0) return;
+
+    auto deadline = Clock::now() + spin_;
+    while (!closed_ && Clock::now() < deadline) {
+        if (inbound_->writePos.load(std::memory_order_acquire) != inbound_->readPos.load(std::memory_order_relaxed)) {
+            drain();
+            spin_ = std::min(spin_ * 2, maxSpin_);
+            return;
+        }
+        cpuRelax();
+    }
+    spin_ = std::max<std::chrono::nanoseconds>(spin_ / 2, kMinSpin);
+}
+
+size_t ShmTransport::write(std::string_view data) {
+    uint64_t w = outbound_->writePos.load(std::memory_order_relaxed);
+    uint64_t r = outbound_->readPos.load(std::memory_order_acquire);
+    uint64_t capacity = ringSize_;
+    if (w - r > capacity) {
+        ERROR("ShmTransport::write() corrupted ring, readPos {} writePos {}", r, w);
+        close();
+        return data.length();
+    }
+
+    auto n = std::min(data.length(), static_cast<size_t>(capacity - (w - r)));
+    if (n == 0) return 0;
+
+    auto offset = static_cast<size_t>(w & (capacity - 1));
+    auto first = std::min(n, static_cast<size_t>(capacity) - offset);
+    std::memcpy(outbound_->data() + offset, data.data(), first);
+    std::memcpy(outbound_->data(), data.data() + first, n - first);
+    outbound_->writePos.store(w + n, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (outbound_->readerSleeping.load(std::memory_order_relaxed)) {
+        ringPeer();
+    }
+    return n;
+}
+
+void ShmTransport::flushPending() {
+    if (pending_.empty() || closed_) return;
+    while (!pending_.empty() && !closed_) {
+        size_t n = write(pending_);
+        pending_.erase(0, n);
+        if (n > 0) continue;
+
+        // 队列已满：置位后再检查一次，对端在此期间读出的数据同样不会丢失唤醒
+        outbound_->writerBlocked.store(1, std::memory_order_seq_cst);
+        uint64_t r = outbound_->readPos.load(std::memory_order_seq_cst);
+        if (outbound_->writePos.load(std::memory_order_relaxed) - r >= ringSize_) return;
+    }
+    outbound_->writerBlocked.store(0, std::memory_order_relaxed);
+    if (pending_.empty() && writeCompleteCallback_) {
+        loop_->queueInLoop([self = shared_from_this()]() {
+            if (self->writeCompleteCallback_) self->writeCompleteCallback_();
+        });
+    }
+}
+
+void ShmTransport::ringPeer() {
+    uint64_t one = 1;
+    if (::write(peerDoorbell_, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        SYSERR("ShmTransport::ringPeer() write");
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <mudong-ev/src/Channel.hpp>
+
+#include "utils/util.hpp"
+
+namespace mudong {
+
+namespace rpc {
+
+struct ShmRing;
+
+/* 同一主机上基于共享内存的传输，绕过socket收发数据
+client创建一块memfd共享内存，其中是两个方向各一个的SPSC字节环形队列，以及两端各自的eventfd门铃，
+通过unix socket以SCM_RIGHTS传给server，之后的数据只经过共享内存。这条unix socket连接保留下来，
+作为TcpConnection交给上层，用于感知对端的连接和断开，因此上层的连接回调、Session和stub都无需改动。
+
+环形队列中传输的仍然是完整的帧，格式见codec/Frame.hpp，读端把数据取到Buffer中，交给与TCP相同的拆包逻辑。
+读端进入epoll等待前先在共享内存中置位readerSleeping，写端写入后只在该位被置位时才敲门铃，
+因此两端都处于忙碌状态时收发不产生任何系统调用；读端收到数据后还会自适应地自旋一小段时间，
+在请求-响应的来回之间不必经过epoll唤醒
+ */
+class ShmTransport : noncopyable,
+                     public std::enable_shared_from_this<ShmTransport> {
+
+public:
+    using MessageCallback = std::function<void(Buffer&)>;
+    using HighWaterMarkCallback = std::function<void(size_t)>;
+    using WriteCompleteCallback = std::function<void()>;
+
+    // client端：创建共享内存和门铃，通过已连接的unix socket传给server，失败返回nullptr
+    static std::shared_ptr<ShmTransport> connect(EventLoop* loop, int connfd, size_t ringSize);
+    // server端：从刚accept的unix socket接收client创建的共享内存和门铃，失败返回nullptr。
+    // 需在connfd可读之后调用，见UnixServer::setHandshakeCallback
+    static std::shared_ptr<ShmTransport> accept(EventLoop* loop, int connfd);
+
+    ~ShmTransport();
+
+    void setMessageCallback(const MessageCallback& cb) {
+        messageCallback_ = cb;
+    }
+
+    // 与TcpConnection的同名回调对应：暂存的数据增长到超过mark时调用highWaterMark，暂存的数据全部写入队列后调用writeComplete，
+    // 都在loop线程中执行。对端不读时据此停止产生新的输出，pending_不会无限增长
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t mark) {
+        highWaterMarkCallback_ = cb;
+        highWaterMark_ = mark;
+    }
+
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
+        writeCompleteCallback_ = cb;
+    }
+
+    // 收到数据后自旋等待后续数据的最长时间，为0时不自旋
+    void setMaxSpin(std::chrono::nanoseconds maxSpin) {
+        maxSpin_ = maxSpin;
+    }
+
+    // 只能在loop线程调用，开始接收数据
+    void start();
+
+    // 可在任意线程调用，data为一个或多个完整的帧，队列已满时暂存，等对端读出后再写入
+    void send(std::string_view data);
+
+    // 只能在loop线程调用，停止收发并解除对回调的引用，之后send的数据被丢弃
+    void close();
+
+    // 只能在loop线程调用，与TcpConnection的同名函数对应。暂停期间不再从inbound_中取数据，对端写满队列后自行等待
+    void stopRead() {
+        reading_ = false;
+    }
+    void startRead();
+
+private:
+    ShmTransport(EventLoop* loop, char* base, size_t mapLen, size_t ringSize, ShmRing* inbound, ShmRing* outbound, int doorbell, int peerDoorbell);
+
+    void handleDoorbell();
+    void pump();
+    bool drain();
+    void spin();
+    size_t write(std::string_view data);
+    void flushPending();
+    void appendPending(std::string_view data);
+    void ringPeer();
+
+private:
+    EventLoop* loop_;
+    char* const base_;
+    const size_t mapLen_;
+    const size_t ringSize_;   // 握手时校验过的队列容量，不读共享内存中对端可改写的capacity
+    ShmRing* const inbound_;  // 对端写，本端读
+    ShmRing* const outbound_; // 本端写，对端读
+    const int doorbell_;      // 本端的门铃，对端敲
+    const int peerDoorbell_;
+    ev::Channel channel_;
+
+    bool closed_;
+    bool reading_;
+    Buffer buffer_;           // 已从inbound_中取出、尚未拆包的数据
+    std::string pending_;     // outbound_已满时暂存的数据
+    std::chrono::nanoseconds maxSpin_;
+    std::chrono::nanoseconds spin_; // 当前的自旋时长，自旋期间等到数据则加倍，否则减半
+    MessageCallback messageCallback_;
+    HighWaterMarkCallback highWaterMarkCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    size_t highWaterMark_;
+}; // class ShmTransport
+
+using ShmTransportPtr = std::shared_ptr<ShmTransport>;
+
+} // namespace rpc
+
+} // namespace mudong
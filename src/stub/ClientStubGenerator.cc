@@ -8,7 +8,8 @@ std::string clientStubTemplate(
         const std::string& macroName,
         const std::string& stubClassName,
         const std::string& procedureDefinitions,
-        const std::string& notifyDefinitions)
+        const std::string& notifyDefinitions,
+        const std::string& eventDefinitions)
 {
     std::string str = R"(
 /*
@@ -32,18 +33,13 @@ public:
     [stubClassName](EventLoop* loop, const InetAddress& serverAddress):
             client_(loop, serverAddress)
     {
-        client_.setConnectionCallback([this](const TcpConnectionPtr& conn){
-            if (conn->connected()) {
-                INFO("connected");
-                conn_ = conn;
-                cb_(conn_);
-            }
-            else {
-                INFO("disconnected");
-                assert(conn_ != nullptr);
-                cb_(conn_);
-            }
-        });
+        initConnectionCallback();
+    }
+
+    [stubClassName](EventLoop* loop, const UnixAddress& serverAddress):
+            client_(loop, serverAddress)
+    {
+        initConnectionCallback();
     }
 
     ~[stubClassName]() = default;
@@ -55,10 +51,39 @@ public:
         cb_ = cb;
     }
 
+    void setFrameType(FrameType type) { client_.setFrameType(type); }
+
+    void setCodec(Codec codec) { client_.setCodec(codec); }
+
+    void setCompressThreshold(size_t threshold) { client_.setCompressThreshold(threshold); }
+
+    void setShmTransport(size_t ringSize) { client_.setShmTransport(ringSize); }
+
+    void setMethodIds(bool on) { client_.setMethodIds(on); }
+
+    void setCallTimeout(std::chrono::milliseconds timeout) { client_.setCallTimeout(timeout); }
+
     [procedureDefinitions]
     [notifyDefinitions]
+    [eventDefinitions]
 
 private:
+    void initConnectionCallback()
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr& conn){
+            if (conn->connected()) {
+                INFO("connected");
+                conn_ = conn;
+                cb_(conn_);
+            }
+            else {
+                INFO("disconnected");
+                assert(conn_ != nullptr);
+                cb_(conn_);
+            }
+        });
+    }
+
     TcpConnectionPtr conn_;
     ConnectionCallback cb_;
     BaseClient client_;
@@ -72,6 +97,7 @@ private:
     replaceAll(str, "[stubClassName]", stubClassName);
     replaceAll(str, "[procedureDefinitions]", procedureDefinitions);
     replaceAll(str, "[notifyDefinitions]", notifyDefinitions);
+    replaceAll(str, "[eventDefinitions]", eventDefinitions);
     return str;
 }
 
@@ -89,7 +115,7 @@ void [procedureName]([procedureArgs] const ResponseCallback& cb) {
 
     mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
     call.addMember("jsonrpc", "2.0");
-    call.addMember("method", "[serviceName].[procedureName]");
+    call.addMember("method", client_.methodKey("[serviceName].[procedureName]"));
     call.addMember("params", params);
 
     assert(conn_ != nullptr);
@@ -103,6 +129,90 @@ void [procedureName]([procedureArgs] const ResponseCallback& cb) {
     return str;
 }
 
+// 流式返回的调用，每收到一块调用一次onChunk，见BaseClient::sendStreamCall
+std::string streamDefineTemplate(
+        const std::string& serviceName,
+        const std::string& procedureName,
+        const std::string& procedureArgs,
+        const std::string& paramMembers)
+{
+    std::string str = R"(
+void [procedureName]([procedureArgs] const ChunkCallback& onChunk, const ResponseCallback& cb) {
+    mudong::json::Value params(mudong::json::ValueType::TYPE_OBJECT);
+    [paramMembers]
+
+    mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
+    call.addMember("jsonrpc", "2.0");
+    call.addMember("method", client_.methodKey("[serviceName].[procedureName]"));
+    call.addMember("params", params);
+
+    assert(conn_ != nullptr);
+    client_.sendStreamCall(conn_, call, onChunk, cb);
+}
+)";
+    replaceAll(str, "[serviceName]", serviceName);
+    replaceAll(str, "[procedureName]", procedureName);
+    replaceAll(str, "[procedureArgs]", procedureArgs);
+    replaceAll(str, "[paramMembers]", paramMembers);
+    return str;
+}
+
+// 流式上传的调用，数据通过返回的UploadWriter逐块发送，见BaseClient::sendUploadCall
+std::string uploadDefineTemplate(
+        const std::string& serviceName,
+        const std::string& procedureName,
+        const std::string& procedureArgs,
+        const std::string& paramMembers)
+{
+    std::string str = R"(
+UploadWriter [procedureName]([procedureArgs] const ResponseCallback& cb) {
+    mudong::json::Value params(mudong::json::ValueType::TYPE_OBJECT);
+    [paramMembers]
+
+    mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
+    call.addMember("jsonrpc", "2.0");
+    call.addMember("method", client_.methodKey("[serviceName].[procedureName]"));
+    call.addMember("params", params);
+
+    assert(conn_ != nullptr);
+    return client_.sendUploadCall(conn_, call, cb);
+}
+)";
+    replaceAll(str, "[serviceName]", serviceName);
+    replaceAll(str, "[procedureName]", procedureName);
+    replaceAll(str, "[procedureArgs]", procedureArgs);
+    replaceAll(str, "[paramMembers]", paramMembers);
+    return str;
+}
+
+// 协程风格的调用，返回值co_await后得到CallResult，见client/BaseClient.hpp
+std::string coroutineDefineTemplate(
+        const std::string& serviceName,
+        const std::string& procedureName,
+        const std::string& procedureArgs,
+        const std::string& paramMembers)
+{
+    std::string str = R"(
+CallAwaiter [procedureName]([procedureArgs]) {
+    mudong::json::Value params(mudong::json::ValueType::TYPE_OBJECT);
+    [paramMembers]
+
+    mudong::json::Value call(mudong::json::ValueType::TYPE_OBJECT);
+    call.addMember("jsonrpc", "2.0");
+    call.addMember("method", client_.methodKey("[serviceName].[procedureName]"));
+    call.addMember("params", params);
+
+    assert(conn_ != nullptr);
+    return client_.call(conn_, call);
+}
+)";
+    replaceAll(str, "[serviceName]", serviceName);
+    replaceAll(str, "[procedureName]", procedureName);
+    replaceAll(str, "[procedureArgs]", procedureArgs);
+    replaceAll(str, "[paramMembers]", paramMembers);
+    return str;
+}
+
 std::string notifyDefineTemplate(
         const std::string& serviceName,
         const std::string& notifyName,
@@ -116,7 +226,8 @@ void [notifyName]([notifyArgs]) {
 
     mudong::json::Value notify(mudong::json::ValueType::TYPE_OBJECT);
     notify.addMember("jsonrpc", "2.0");
-    notify.addMember("method", "Hello.Goodbye");
+    notify.addMember("method", client_.methodKey("[serviceName].[notifyName]"));
+    notify.addMember("params", params);
 
     assert(conn_ != nullptr);
     client_.sendNotify(conn_, notify);
@@ -129,40 +240,66 @@ void [notifyName]([notifyArgs]) {
     return str;
 }
 
-std::string paramMemberTemplate(const std::string& paramName) {
+// 订阅server推送的事件，handler在client的IO线程中执行，见BaseClient::subscribe
+std::string eventDefineTemplate(
+        const std::string& serviceName,
+        const std::string& eventName,
+        const std::string& eventArgs,
+        const std::string& argsFromParams,
+        const std::string& handlerArgs)
+{
     std::string str = R"(
-params.addMember("[paramName]", [paramName]);
+void subscribe[eventName](const std::function<void([eventArgs])>& handler, const ResponseCallback& cb) {
+    client_.setNotifyCallback("[serviceName].[eventName]", [handler](mudong::json::Value& params) {
+        [argsFromParams]
+        handler([handlerArgs]);
+    });
+
+    assert(conn_ != nullptr);
+    client_.subscribe(conn_, "[serviceName].[eventName]", cb);
+}
+
+void unsubscribe[eventName](const ResponseCallback& cb) {
+    assert(conn_ != nullptr);
+    client_.unsubscribe(conn_, "[serviceName].[eventName]", cb);
+}
 )";
-    replaceAll(str, "[paramName]", paramName);
+    replaceAll(str, "[serviceName]", serviceName);
+    replaceAll(str, "[eventName]", eventName);
+    replaceAll(str, "[eventArgs]", eventArgs);
+    replaceAll(str, "[argsFromParams]", argsFromParams);
+    replaceAll(str, "[handlerArgs]", handlerArgs);
     return str;
 }
 
-std::string argTemplate(
+// 生成代码： auto argName = params["argName"].getXXX(); object和array类型直接取Value
+std::string argFromParamsTemplate(
         const std::string& argName,
         mudong::json::ValueType argType)
 {
-    std::string str = R"([argType] [argName])";
-    auto typeStr = [=](){
+    std::string str = R"(
+auto [argName] = params["[argName]"][method];)";
+    std::string method = [=](){
         switch (argType) {
+            case mudong::json::ValueType::TYPE_BOOL:
+                return ".getBool()";
             case mudong::json::ValueType::TYPE_INT32:
-                return "int32_t";
+                return ".getInt32()";
             case mudong::json::ValueType::TYPE_INT64:
-                return "int64_t";
+                return ".getInt64()";
             case mudong::json::ValueType::TYPE_DOUBLE:
-                return "double";
-            case mudong::json::ValueType::TYPE_BOOL:
-                return "bool";
+                return ".getDouble()";
             case mudong::json::ValueType::TYPE_STRING:
-                return "std::string";
+                return ".getString()";
             case mudong::json::ValueType::TYPE_OBJECT:
             case mudong::json::ValueType::TYPE_ARRAY:
-                return "mudong::json::Value";
+                return "";
             default:
                 assert(false && "bad arg type");
                 return "bad type";
         }
     }();
-    replaceAll(str, "[argType]", typeStr);
+    replaceAll(str, "[method]", method);
     replaceAll(str, "[argName]", argName);
     return str;
 }
@@ -174,8 +311,9 @@ std::string ClientStubGenerator::genStub() {
     auto stubClassName = genStubClassName();
     auto procedureDefinitions = genProcedureDefinitions();
     auto notifyDefinitions = genNotifyDefinitions();
+    auto eventDefinitions = genEventDefinitions();
 
-    return clientStubTemplate(macroName, stubClassName, procedureDefinitions, notifyDefinitions); 
+    return clientStubTemplate(macroName, stubClassName, procedureDefinitions, notifyDefinitions, eventDefinitions);
 }
 
 std::string ClientStubGenerator::genMacroName() {
@@ -200,12 +338,37 @@ std::string ClientStubGenerator::genProcedureDefinitions() {
         auto  procedureArgs = genGenericArgs(r, true);
         auto  paramMembers = genGenericParamMembers(r);
 
+        if (r.stream) {
+            result.append(streamDefineTemplate(
+                    serviceName,
+                    procedureName,
+                    procedureArgs,
+                    paramMembers));
+            continue;
+        }
+        if (r.upload) {
+            result.append(uploadDefineTemplate(
+                    serviceName,
+                    procedureName,
+                    procedureArgs,
+                    paramMembers));
+            continue;
+        }
+
         auto str = procedureDefineTemplate(
                 serviceName,
                 procedureName,
                 procedureArgs,
                 paramMembers);
         result.append(str);
+
+        if (coroutine_) {
+            result.append(coroutineDefineTemplate(
+                    serviceName,
+                    procedureName,
+                    genGenericArgs(r, false),
+                    paramMembers));
+        }
     }
     return result;
 }
@@ -230,6 +393,32 @@ std::string ClientStubGenerator::genNotifyDefinitions() {
     return result;
 }
 
+std::string ClientStubGenerator::genEventDefinitions() {
+    std::string result;
+
+    auto& serviceName = serviceInfo_.name;
+
+    for (auto& e : serviceInfo_.events) {
+        std::string argsFromParams;
+        std::string handlerArgs;
+        for (auto& p : e.params.getObject()) {
+            auto name = p.key.getString();
+            argsFromParams.append(argFromParamsTemplate(name, p.value.getType()));
+            if (!handlerArgs.empty()) handlerArgs.append(", ");
+            handlerArgs.append(name);
+        }
+
+        auto str = eventDefineTemplate(
+                serviceName,
+                e.name,
+                genGenericArgs(e, false),
+                argsFromParams,
+                handlerArgs);
+        result.append(str);
+    }
+    return result;
+}
+
 template <typename Rpc>
 std::string ClientStubGenerator::genGenericArgs(const Rpc& r, bool appendComma) {
     std::string result;
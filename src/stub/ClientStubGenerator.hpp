@@ -20,6 +20,7 @@ private:
     std::string genMacroName();
     std::string genProcedureDefinitions();
     std::string genNotifyDefinitions();
+    std::string genEventDefinitions();
 
     template<typename Rpc>
     std::string genGenericArgs(const Rpc& r, bool appendCommand);
@@ -11,8 +11,10 @@ std::string serviceStubTemplate(
             const std::string& userClassName,
             const std::string& stubClassName,
             const std::string& serviceName,
+            const std::string& extraIncludes,
             const std::string& stubProcedureBindings,
-            const std::string& stubProcedureDefinitions)
+            const std::string& stubProcedureDefinitions,
+            const std::string& stubEventDefinitions)
 {
     std::string str = 
 R"(
@@ -27,7 +29,7 @@ R"(
 #include "utils/util.hpp"
 #include "server/RpcServer.hpp"
 #include "server/RpcService.hpp"
-
+[extraIncludes]
 class [userClassName];
 
 namespace mudong {
@@ -38,7 +40,9 @@ template <typename S>
 class [stubClassName]: noncopyable
 {
 protected:
-    explicit [stubClassName](RpcServer& server) {
+    explicit [stubClassName](RpcServer& server)
+            : server_(server)
+    {
         static_assert(std::is_same_v<S, [userClassName]>,
                       "derived class name should be '[userClassName]'");
 
@@ -51,6 +55,8 @@ protected:
 
     ~[stubClassName]() = default;
 
+    [stubEventDefinitions]
+
 private:
     [stubProcedureDefinitions]
 
@@ -58,6 +64,8 @@ private:
     S& convert() {
         return static_cast<S&>(*this);
     }
+
+    RpcServer& server_;
 };
 
 }
@@ -70,8 +78,10 @@ private:
     replaceAll(str, "[userClassName]", userClassName);
     replaceAll(str, "[stubClassName]", stubClassName);
     replaceAll(str, "[serviceName]", serviceName);
+    replaceAll(str, "[extraIncludes]", extraIncludes);
     replaceAll(str, "[stubProcedureBindings]", stubProcedureBindings);
     replaceAll(str, "[stubProcedureDefinitions]", stubProcedureDefinitions);
+    replaceAll(str, "[stubEventDefinitions]", stubEventDefinitions);
     return str;
 }
 
@@ -79,17 +89,29 @@ std::string stubProcedureBindTemplate(
         const std::string& procedureName,
         const std::string& stubClassName,
         const std::string& stubProcedureName,
-        const std::string& procedureParams)
+        const std::string& procedureParams,
+        const std::string& executor,
+        const std::string& priority,
+        const std::string& cacheTtl,
+        const std::string& coalesce,
+        const std::string& stream,
+        const std::string& upload)
 {
     std::string str = 
 R"(
 service->addProcedureReturn("[procedureName]", new ProcedureReturn(
-        std::bind(&[stubClassName]::[stubProcedureName], this, _1, _2)
+        std::bind(&[stubClassName]::[stubProcedureName], this, _1, _2, _3, _4, _5)
         [procedureParams]
-));
+), "[executor]", Priority::[priority], std::chrono::milliseconds([cacheTtl]), [coalesce], [stream], [upload]);
 )";
 
     replaceAll(str, "[procedureName]", procedureName);
+    replaceAll(str, "[executor]", executor);
+    replaceAll(str, "[priority]", priority);
+    replaceAll(str, "[cacheTtl]", cacheTtl);
+    replaceAll(str, "[coalesce]", coalesce);
+    replaceAll(str, "[stream]", stream);
+    replaceAll(str, "[upload]", upload);
     replaceAll(str, "[stubClassName]", stubClassName);
     replaceAll(str, "[stubProcedureName]", stubProcedureName);
     replaceAll(str, "[procedureParams]", procedureParams);
@@ -100,17 +122,21 @@ std::string stubNotifyBindTemplate(
         const std::string& notifyName,
         const std::string& stubClassName,
         const std::string& stubNotifyName,
-        const std::string& notifyParams)
+        const std::string& notifyParams,
+        const std::string& executor,
+        const std::string& priority)
 {
     std::string str =
 R"(
 service->addProcedureNotify("[notifyName]", new ProcedureNotify(
         std::bind(&[stubClassName]::[stubNotifyName], this, _1)
         [notifyParams]
-));
+), "[executor]", Priority::[priority]);
 )";
 
     replaceAll(str, "[notifyName]", notifyName);
+    replaceAll(str, "[executor]", executor);
+    replaceAll(str, "[priority]", priority);
     replaceAll(str, "[stubClassName]", stubClassName);
     replaceAll(str, "[stubNotifyName]", stubNotifyName);
     replaceAll(str, "[notifyParams]", notifyParams);
@@ -121,44 +147,44 @@ std::string stubProcedureDefineTemplate(
         const std::string& paramsFromJsonArray,
         const std::string& paramsFromJsonObject,
         const std::string& stubProcedureName,
-        const std::string& procedureName,
-        const std::string& procedureArgs)
+        const std::string& procedureCall)
 {
    std::string str =
-R"(void [stubProcedureName](json::Value& request, const RpcDoneCallback& done) {
+R"(void [stubProcedureName](json::Value& request, const RpcDoneCallback& done, Deadline deadline, const FlowControlPtr& flow,
+                         const StreamReaderPtr& upload) {
     auto& params = request["params"];
 
     if (params.isArray()) {
         [paramsFromJsonArray]
-        convert().[procedureName]([procedureArgs] UserDoneCallback(request, done));
+        [procedureCall]
     }
     else {
         [paramsFromJsonObject]
-        convert().[procedureName]([procedureArgs] UserDoneCallback(request, done));
+        [procedureCall]
     }
 })";
 
     replaceAll(str, "[paramsFromJsonArray]", paramsFromJsonArray);
     replaceAll(str, "[paramsFromJsonObject]", paramsFromJsonObject);
     replaceAll(str, "[stubProcedureName]", stubProcedureName);
-    replaceAll(str, "[procedureName]", procedureName);
-    replaceAll(str, "[procedureArgs]", procedureArgs);
+    replaceAll(str, "[procedureCall]", procedureCall);
     return str;
 }
 
 std::string stubProcedureDefineTemplate(
         const std::string& stubProcedureName,
-        const std::string& procedureName)
+        const std::string& procedureCall)
 {
     std::string str =
 R"(
-void [stubProcedureName](json::Value& request, const RpcDoneCallback& done) {
-    convert().[procedureName](UserDoneCallback(request, done));
+void [stubProcedureName](json::Value& request, const RpcDoneCallback& done, Deadline deadline, const FlowControlPtr& flow,
+                         const StreamReaderPtr& upload) {
+    [procedureCall]
 }
 )";
 
     replaceAll(str, "[stubProcedureName]", stubProcedureName);
-    replaceAll(str, "[procedureName]", procedureName);
+    replaceAll(str, "[procedureCall]", procedureCall);
     return str;
 }
 
@@ -166,8 +192,7 @@ std::string stubNotifyDefineTemplate(
         const std::string& paramsFromJsonArray,
         const std::string& paramsFromJsonObject,
         const std::string& stubNotifyName,
-        const std::string& notifyName,
-        const std::string& notifyArgs)
+        const std::string& notifyCall)
 {
     std::string str =
 R"(
@@ -177,18 +202,17 @@ void [stubNotifyName](json::Value& request)
 
     if (params.isArray()) {
         [paramsFromJsonArray]
-        convert().[NotifyName]([notifyArgs]);
+        [notifyCall]
     }
     else {
         [paramsFromJsonObject]
-        convert().[NotifyName]([notifyArgs]);
+        [notifyCall]
     }
 }
 )";
 
-    replaceAll(str, "[notifyName]", notifyName);
     replaceAll(str, "[stubNotifyName]", stubNotifyName);
-    replaceAll(str, "[notifyArgs]", notifyArgs);
+    replaceAll(str, "[notifyCall]", notifyCall);
     replaceAll(str, "[paramsFromJsonArray]", paramsFromJsonArray);
     replaceAll(str, "[paramsFromJsonObject]", paramsFromJsonObject);
     return str;
@@ -196,17 +220,17 @@ void [stubNotifyName](json::Value& request)
 
 std::string stubNotifyDefineTemplate(
         const std::string& stubNotifyName,
-        const std::string& notifyName)
+        const std::string& notifyCall)
 {
     std::string str =
 R"(
 void [stubNotifyName](json::Value& request) {
-    convert().[notifyName]();
+    [notifyCall]
 }
 )";
 
     replaceAll(str, "[stubNotifyName]", stubNotifyName);
-    replaceAll(str, "[notifyName]", notifyName);
+    replaceAll(str, "[notifyCall]", notifyCall);
     return str;
 }
 
@@ -242,6 +266,29 @@ std::string argsDefineTemplate(
     return str;
 }
 
+// 生成代码： size_t publishName(args) { ... return server_.publish("Service.Name", params); }
+std::string stubEventDefineTemplate(
+        const std::string& eventName,
+        const std::string& topic,
+        const std::string& eventArgs,
+        const std::string& eventParams)
+{
+    std::string str =
+R"(
+size_t publish[eventName]([eventArgs]) {
+    json::Value params(json::ValueType::TYPE_OBJECT);
+    [eventParams]
+    return server_.publish("[topic]", params);
+}
+)";
+
+    replaceAll(str, "[eventName]", eventName);
+    replaceAll(str, "[topic]", topic);
+    replaceAll(str, "[eventArgs]", eventArgs);
+    replaceAll(str, "[eventParams]", eventParams);
+    return str;
+}
+
 } // anonymous namespace
 
 std::string ServiceStubGenerator::genStub() {
@@ -256,7 +303,12 @@ std::string ServiceStubGenerator::genStub() {
     auto definitions = genStubProcedureDefinitions();
     definitions.append(genStubNotifyDefinitions());
 
-    return serviceStubTemplate(macroName, userClassName, stubClassName, serviceName, bindings, definitions);
+    // 协程风格的handler返回Task，由spawn驱动执行
+    std::string extraIncludes = coroutine_ ? "#include \"coro/Task.hpp\"\n" : "";
+
+    auto events = genStubEventDefinitions();
+
+    return serviceStubTemplate(macroName, userClassName, stubClassName, serviceName, extraIncludes, bindings, definitions, events);
 }
 
 std::string ServiceStubGenerator::genMacroName() {
@@ -283,7 +335,9 @@ std::string ServiceStubGenerator::genStubProcedureBindings() {
         auto stubProcedureName = genStubGenericName(p);
         auto procedureParams = genGenericParams(p);
 
-        auto binding = stubProcedureBindTemplate(procedureName, stubClassName, stubProcedureName, procedureParams);
+        auto binding = stubProcedureBindTemplate(procedureName, stubClassName, stubProcedureName, procedureParams, p.executor, p.priority,
+                                                 std::to_string(p.cacheTtl), p.coalesce ? "true" : "false",
+                                                 p.stream ? "true" : "false", p.upload ? "true" : "false");
         result.append(binding);
         result.append("\n");
     }
@@ -293,25 +347,23 @@ std::string ServiceStubGenerator::genStubProcedureBindings() {
 std::string ServiceStubGenerator::genStubProcedureDefinitions() {
     std::string result;
     for (auto& r : serviceInfo_.rpcReturn) {
-        auto procedureName = r.name;
         auto stubProcedureName = genStubGenericName(r);
+        auto procedureCall = genProcedureCall(r);
 
         if (r.params.getSize() > 0) {
             auto paramsFromJsonArray = genParamsFromJsonArray(r);
             auto paramsFromJsonObject = genParamsFromJsonObject(r);
-            auto procedureArgs = genGenericArgs(r);
             auto define = stubProcedureDefineTemplate(
                     paramsFromJsonArray,
                     paramsFromJsonObject,
                     stubProcedureName,
-                    procedureName,
-                    procedureArgs);
+                    procedureCall);
 
             result.append(define);
             result.append("\n");
         }
         else {
-            auto define = stubProcedureDefineTemplate(stubProcedureName, procedureName);
+            auto define = stubProcedureDefineTemplate(stubProcedureName, procedureCall);
 
             result.append(define);
             result.append("\n");
@@ -332,7 +384,9 @@ std::string ServiceStubGenerator::genStubNotifyBindings() {
                 notifyName,
                 stubClassName,
                 stubNotifyName,
-                notifyParams);
+                notifyParams,
+                p.executor,
+                p.priority);
         result.append(binding);
         result.append("\n");
     }
@@ -342,19 +396,17 @@ std::string ServiceStubGenerator::genStubNotifyBindings() {
 std::string ServiceStubGenerator::genStubNotifyDefinitions() {
     std::string result;
     for (auto& r: serviceInfo_.rpcNotify) {
-        auto notifyName = r.name;
         auto stubNotifyName = genStubGenericName(r);
+        auto notifyCall = genNotifyCall(r);
 
         if (r.params.getSize() > 0) {
             auto paramsFromJsonArray = genParamsFromJsonArray(r);
             auto paramsFromJsonObject = genParamsFromJsonObject(r);
-            auto notifyArgs = genGenericArgs(r);
             auto define = stubNotifyDefineTemplate(
                     paramsFromJsonArray,
                     paramsFromJsonObject,
                     stubNotifyName,
-                    notifyName,
-                    notifyArgs);
+                    notifyCall);
 
             result.append(define);
             result.append("\n");
@@ -362,7 +414,7 @@ std::string ServiceStubGenerator::genStubNotifyDefinitions() {
         else {
             auto define = stubNotifyDefineTemplate(
                     stubNotifyName,
-                    notifyName);
+                    notifyCall);
 
             result.append(define);
             result.append("\n");
@@ -371,6 +423,52 @@ std::string ServiceStubGenerator::genStubNotifyDefinitions() {
     return result;
 }
 
+// 每个事件生成一个publish方法，返回收到推送的连接数
+std::string ServiceStubGenerator::genStubEventDefinitions() {
+    std::string result;
+    for (auto& e : serviceInfo_.events) {
+        std::string eventArgs;
+        std::string eventParams;
+        for (auto& m : e.params.getObject()) {
+            auto name = m.key.getString();
+            if (!eventArgs.empty()) eventArgs.append(", ");
+            eventArgs.append(argTemplate(name, m.value.getType()));
+            eventParams.append(paramMemberTemplate(name));
+        }
+        auto topic = serviceInfo_.name + "." + e.name;
+        result.append(stubEventDefineTemplate(e.name, topic, eventArgs, eventParams));
+        result.append("\n");
+    }
+    return result;
+}
+
+// 生成代码： convert().name(args, UserDoneCallback(...)); 协程风格为 spawn(convert().name(args), UserDoneCallback(...));
+// 流式返回的procedure总是回调风格： convert().name(args, StreamWriter(...));
+// 流式上传的procedure同样是回调风格： convert().name(args, upload, UserDoneCallback(...));
+std::string ServiceStubGenerator::genProcedureCall(const RpcReturn& r) {
+    auto args = genGenericArgs(r);
+    if (r.stream) {
+        return "convert()." + r.name + "(" + args + "StreamWriter(request, done, flow));";
+    }
+    if (r.upload) {
+        return "convert()." + r.name + "(" + args + "upload, UserDoneCallback(request, done, deadline));";
+    }
+    std::string done = "UserDoneCallback(request, done, deadline)";
+    if (!coroutine_) {
+        return "convert()." + r.name + "(" + args + done + ");";
+    }
+    if (!args.empty()) args.resize(args.size() - 2); // 去掉末尾的", "
+    return "spawn(convert()." + r.name + "(" + args + "), " + done + ");";
+}
+
+// 生成代码： convert().name(args); 协程风格为 spawn(convert().name(args));
+std::string ServiceStubGenerator::genNotifyCall(const RpcNotify& r) {
+    auto args = genGenericArgs(r);
+    if (!args.empty()) args.resize(args.size() - 2);
+    auto call = "convert()." + r.name + "(" + args + ")";
+    return coroutine_ ? "spawn(" + call + ");" : call + ";";
+}
+
 template <typename Rpc>
 std::string ServiceStubGenerator::genStubGenericName(const Rpc& r) {
     return r.name + "Stub";
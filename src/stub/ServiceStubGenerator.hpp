@@ -22,6 +22,9 @@ private:
     std::string genStubProcedureDefinitions();
     std::string genStubNotifyBindings();
     std::string genStubNotifyDefinitions();
+    std::string genStubEventDefinitions();
+    std::string genProcedureCall(const RpcReturn& r);
+    std::string genNotifyCall(const RpcNotify& r);
 
     template <typename Rpc>
     std::string genStubGenericName(const Rpc& r);
@@ -13,9 +13,47 @@ void expect(bool result, const char* errMsg) {
 
 } // anonymous namespace
 
+std::string mudong::rpc::paramMemberTemplate(const std::string& paramName) {
+    std::string str = R"(
+params.addMember("[paramName]", [paramName]);
+)";
+    replaceAll(str, "[paramName]", paramName);
+    return str;
+}
+
+std::string mudong::rpc::argTemplate(
+        const std::string& argName,
+        mudong::json::ValueType argType)
+{
+    std::string str = R"([argType] [argName])";
+    auto typeStr = [=](){
+        switch (argType) {
+            case mudong::json::ValueType::TYPE_INT32:
+                return "int32_t";
+            case mudong::json::ValueType::TYPE_INT64:
+                return "int64_t";
+            case mudong::json::ValueType::TYPE_DOUBLE:
+                return "double";
+            case mudong::json::ValueType::TYPE_BOOL:
+                return "bool";
+            case mudong::json::ValueType::TYPE_STRING:
+                return "std::string";
+            case mudong::json::ValueType::TYPE_OBJECT:
+            case mudong::json::ValueType::TYPE_ARRAY:
+                return "mudong::json::Value";
+            default:
+                assert(false && "bad arg type");
+                return "bad type";
+        }
+    }();
+    replaceAll(str, "[argType]", typeStr);
+    replaceAll(str, "[argName]", argName);
+    return str;
+}
+
 void StubGenerator::parseProto(json::Value& proto) {
     expect(proto.isObject(), "expect object");
-    expect(proto.getSize() == 2, "expect 'name' and 'rpc' fields in object");
+    expect(proto.getSize() == 2 || proto.getSize() == 3, "expect 'name', 'rpc' and optional 'events' fields in object");
 
     auto nameIter = proto.findMember("name");
 
@@ -31,6 +69,36 @@ void StubGenerator::parseProto(json::Value& proto) {
     for (size_t i = 0; i < n; ++i) {
         parseRpc(rpcIter->value[i]);
     }
+
+    auto eventsIter = proto.findMember("events");
+    if (eventsIter != proto.endMember()) {
+        expect(eventsIter->value.isArray(), "events field must be array");
+        size_t m = eventsIter->value.getSize();
+        for (size_t i = 0; i < m; ++i) {
+            parseEvent(eventsIter->value[i]);
+        }
+    }
+    else {
+        expect(proto.getSize() == 2, "unknown field in object");
+    }
+}
+
+// 服务端推送的事件，client订阅之后server以notify推送，topic为"服务名.事件名"
+void StubGenerator::parseEvent(json::Value& event) {
+    expect(event.isObject(), "event definition must be object");
+
+    auto nameIter = event.findMember("name");
+    expect(nameIter != event.endMember(), "missing name in event definition");
+    expect(nameIter->value.isString(), "event name must be string");
+
+    auto paramsIter = event.findMember("params");
+    bool hasParams = paramsIter != event.endMember();
+    if (hasParams) {
+        validateParams(paramsIter->value);
+    }
+
+    auto paramsValue = hasParams ? paramsIter->value : json::Value(json::ValueType::TYPE_OBJECT);
+    serviceInfo_.events.push_back(RpcEvent(nameIter->value.getString(), paramsValue));
 }
 
 void StubGenerator::parseRpc(json::Value& rpc) {
@@ -52,14 +120,81 @@ void StubGenerator::parseRpc(json::Value& rpc) {
         validateReturns(returnsIter->value);
     }
 
+    // 可选字段，procedure的执行位置，见server/Procedure.hpp
+    std::string executor = "inline";
+    auto executorIter = rpc.findMember("executor");
+    if (executorIter != rpc.endMember()) {
+        expect(executorIter->value.isString(), "executor must be string");
+        executor = executorIter->value.getString();
+        expect(!executor.empty(), "executor must not be empty");
+    }
+
+    // 可选字段，延迟等级，"interactive"（缺省）或"bulk"，见server/Executor.hpp
+    std::string priority = "INTERACTIVE";
+    auto priorityIter = rpc.findMember("priority");
+    if (priorityIter != rpc.endMember()) {
+        expect(priorityIter->value.isString(), "priority must be string");
+        auto value = priorityIter->value.getStringView();
+        expect(value == "interactive" || value == "bulk", "priority must be 'interactive' or 'bulk'");
+        priority = value == "bulk" ? "BULK" : "INTERACTIVE";
+    }
+
+    // 可选字段，"cacheable"为true时server按params缓存结果，"ttl"为有效期，单位毫秒，见server/ResponseCache.hpp
+    int64_t cacheTtl = 0;
+    auto cacheableIter = rpc.findMember("cacheable");
+    auto ttlIter = rpc.findMember("ttl");
+    if (cacheableIter != rpc.endMember()) {
+        expect(cacheableIter->value.isBool(), "cacheable must be bool");
+    }
+    bool cacheable = cacheableIter != rpc.endMember() && cacheableIter->value.getBool();
+    if (cacheable) {
+        expect(hasReturns, "only rpc with returns can be cacheable");
+        expect(ttlIter != rpc.endMember(), "missing ttl for cacheable rpc");
+        expect(ttlIter->value.isInt32() || ttlIter->value.isInt64(), "ttl must be integer");
+        cacheTtl = ttlIter->value.isInt32() ? ttlIter->value.getInt32() : ttlIter->value.getInt64();
+        expect(cacheTtl > 0, "ttl must be positive");
+    }
+    else {
+        expect(ttlIter == rpc.endMember(), "ttl requires cacheable");
+    }
+
+    // 可选字段，为true时server合并params相同的并发调用，见server/SingleFlight.hpp
+    bool coalesce = false;
+    auto coalesceIter = rpc.findMember("coalesce");
+    if (coalesceIter != rpc.endMember()) {
+        expect(coalesceIter->value.isBool(), "coalesce must be bool");
+        coalesce = coalesceIter->value.getBool();
+        expect(!coalesce || hasReturns, "only rpc with returns can be coalesced");
+    }
+
+    // 可选字段，为true时结果通过StreamWriter分块返回，见utils/util.hpp
+    bool stream = false;
+    auto streamIter = rpc.findMember("stream");
+    if (streamIter != rpc.endMember()) {
+        expect(streamIter->value.isBool(), "stream must be bool");
+        stream = streamIter->value.getBool();
+        expect(!stream || hasReturns, "only rpc with returns can be stream");
+        expect(!stream || (!cacheable && !coalesce), "stream rpc can not be cacheable or coalesced");
+    }
+
+    // 可选字段，为true时params之外的数据由client分块上传，通过StreamReader接收，见server/StreamReader.hpp
+    bool upload = false;
+    auto uploadIter = rpc.findMember("upload");
+    if (uploadIter != rpc.endMember()) {
+        expect(uploadIter->value.isBool(), "upload must be bool");
+        upload = uploadIter->value.getBool();
+        expect(!upload || hasReturns, "only rpc with returns can be upload");
+        expect(!upload || (!cacheable && !coalesce && !stream), "upload rpc can not be cacheable, coalesced or stream");
+    }
+
     auto paramsValue = hasParams ? paramsIter->value : json::Value(json::ValueType::TYPE_OBJECT); // 如果没有参数传入那就构造一个Object类型的空Value
 
     if (hasReturns) {
-        RpcReturn rr(nameIter->value.getString(), paramsValue, returnsIter->value);
+        RpcReturn rr(nameIter->value.getString(), paramsValue, returnsIter->value, executor, priority, cacheTtl, coalesce, stream, upload);
         serviceInfo_.rpcReturn.push_back(rr);
     }
     else {
-        RpcNotify rn(nameIter->value.getString(), paramsValue);
+        RpcNotify rn(nameIter->value.getString(), paramsValue, executor, priority);
         serviceInfo_.rpcNotify.push_back(rn);
     }
 }
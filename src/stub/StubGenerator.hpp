@@ -17,21 +17,53 @@ public:
     virtual std::string genStub() = 0;
     virtual std::string genStubClassName() = 0;
 
+    // 生成协程风格的stub：服务端handler返回Task，客户端额外生成可co_await的调用，见coro/Task.hpp
+    void setCoroutine(bool on) {
+        coroutine_ = on;
+    }
+
 protected:
     struct RpcReturn {
-        RpcReturn(const std::string& name_, json::Value& params_, json::Value& returns_)
+        RpcReturn(const std::string& name_, json::Value& params_, json::Value& returns_, const std::string& executor_, const std::string& priority_,
+                  int64_t cacheTtl_, bool coalesce_, bool stream_, bool upload_)
                 : name(name_),
                   params(params_),
-                  returns(returns_)
+                  returns(returns_),
+                  executor(executor_),
+                  priority(priority_),
+                  cacheTtl(cacheTtl_),
+                  coalesce(coalesce_),
+                  stream(stream_),
+                  upload(upload_)
         {}
 
         std::string name;
         mutable json::Value params;
         mutable json::Value returns;
+        std::string executor; // "inline"、"pool"或具名线程池，缺省为"inline"
+        std::string priority; // Priority的枚举值名，"INTERACTIVE"或"BULK"
+        int64_t cacheTtl;     // 结果缓存的有效期，单位毫秒，0表示不缓存
+        bool coalesce;        // 是否合并params相同的并发调用
+        bool stream;          // 是否分块返回结果，returns为每一块的类型
+        bool upload;          // 是否由client在params之外分块上传数据
     };
 
     struct RpcNotify {
-        RpcNotify(const std::string& name_, json::Value& params_)
+        RpcNotify(const std::string& name_, json::Value& params_, const std::string& executor_, const std::string& priority_)
+                : name(name_),
+                  params(params_),
+                  executor(executor_),
+                  priority(priority_)
+        {}
+
+        std::string name;
+        mutable json::Value params;
+        std::string executor;
+        std::string priority;
+    };
+
+    struct RpcEvent {
+        RpcEvent(const std::string& name_, json::Value& params_)
                 : name(name_),
                   params(params_)
         {}
@@ -44,13 +76,16 @@ protected:
         std::string name;
         std::vector<RpcReturn> rpcReturn;
         std::vector<RpcNotify> rpcNotify;
+        std::vector<RpcEvent> events; // 服务端推送的事件
     };
 
     ServiceInfo serviceInfo_;
+    bool coroutine_ = false;
 
 private:
     void parseProto(json::Value& proto);
     void parseRpc(json::Value& rpc);
+    void parseEvent(json::Value& event);
     void validateParams(json::Value& params);
     void validateReturns(json::Value& returns);
 
@@ -65,6 +100,12 @@ inline void replaceAll(std::string& str, const std::string& from,  const std::st
     }
 }
 
+// 生成代码： params.addMember("paramName", paramName);
+std::string paramMemberTemplate(const std::string& paramName);
+
+// 生成代码： argType argName，argType为参数类型对应的C++类型
+std::string argTemplate(const std::string& argName, json::ValueType argType);
+
 } // namespace rpc
 
 } // namespace mudong
\ No newline at end of file
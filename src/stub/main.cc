@@ -10,7 +10,7 @@
 using namespace mudong::rpc;
 
 static void usage() {
-    std::cerr << "usage: stub_generator <-c/s> [-o] [-i input]\n";
+    std::cerr << "usage: stub_generator <-c/s> [-o] [-r] [-i input]\n";
     exit(1);
 }
 
@@ -41,7 +41,7 @@ static std::unique_ptr<StubGenerator> makeGenerator(bool serverSide, mudong::jso
     }
 }
 
-static void genStub(FILE* input, bool serverSide, bool outputToFile) {
+static void genStub(FILE* input, bool serverSide, bool outputToFile, bool coroutine) {
     mudong::json::FileReadStream is(input);
     mudong::json::Document proto;
     auto err = proto.parseStream(is);
@@ -51,6 +51,7 @@ static void genStub(FILE* input, bool serverSide, bool outputToFile) {
     }
     try {
         auto generator = makeGenerator(serverSide, proto);
+        generator->setCoroutine(coroutine);
         writeToFile(*generator, outputToFile);
     }
     catch (StubException& e) {
@@ -63,11 +64,12 @@ int main(int argc, char** argv) {
     bool serverSide = false;
     bool clientSide = false;
     bool outputToFile = false;
+    bool coroutine = false;
     const char* inputFileName = nullptr;
 
     int opt;
-    // 使用getopt来处理传入参数的解析，i:表示 -i 后面必须要有一个额外参数传入，"csi:o"表示可匹配的参数列表 -c -s -i filename -o
-    while ((opt = getopt(argc, argv, "csi:o")) != -1) {
+    // 使用getopt来处理传入参数的解析，i:表示 -i 后面必须要有一个额外参数传入，"csi:or"表示可匹配的参数列表 -c -s -i filename -o -r
+    while ((opt = getopt(argc, argv, "csi:or")) != -1) {
         switch (opt) {
         case 'c':
             clientSide = true;
@@ -78,6 +80,9 @@ int main(int argc, char** argv) {
         case 'o':
             outputToFile = true;
             break;
+        case 'r':
+            coroutine = true; // 生成协程风格的stub
+            break;
         case 'i':
             inputFileName = optarg; // optarg 为-i filename 中的filename
             break;
@@ -103,11 +108,11 @@ int main(int argc, char** argv) {
 
     try {
         if (serverSide) {
-            genStub(input, true, outputToFile);
+            genStub(input, true, outputToFile, coroutine);
             rewind(input);
         }
         if (clientSide) {
-            genStub(input, false, outputToFile);
+            genStub(input, false, outputToFile, coroutine);
         }
     }
     catch (StubException& e) {
@@ -7,13 +7,16 @@ namespace mudong {
 
 namespace rpc {
 
-// JSON-RPC规范错误码定义
+// JSON-RPC规范错误码定义，-32000到-32099为规范保留给实现自定义的server error
 #define ERROR_MAP(XX) \
     XX(PARSE_ERROR, -32700, "Parse error") \
     XX(INVALID_REQUEST, -32600, "Invalid request") \
     XX(METHOD_NOT_FOUND, -32601,"Method not found") \
     XX(INVALID_PARAMS, -32602, "Invalid params") \
     XX(INTERNAL_ERROR, -32603, "Internal error") \
+    XX(SERVER_OVERLOADED, -32000, "Server overloaded") \
+    XX(REQUEST_TIMEOUT, -32001, "Request timeout") \
+    XX(SERVER_DRAINING, -32002, "Server draining") \
 
 enum class ERROR {
 #define GEN_ERROR(e, c, s) RPC_##e,
@@ -51,6 +54,9 @@ private:
         case -32601: return ERROR::RPC_METHOD_NOT_FOUND;
         case -32602: return ERROR::RPC_INVALID_PARAMS;
         case -32603: return ERROR::RPC_INTERNAL_ERROR;
+        case -32000: return ERROR::RPC_SERVER_OVERLOADED;
+        case -32001: return ERROR::RPC_REQUEST_TIMEOUT;
+        case -32002: return ERROR::RPC_SERVER_DRAINING;
         default: assert(false && "bad error code");
         }
     }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace mudong {
+
+namespace rpc {
+
+// AF_UNIX流式套接字地址，与InetAddress对应。以'@'开头的路径表示Linux的abstract namespace，不在文件系统中创建文件
+class UnixAddress {
+
+public:
+    explicit UnixAddress(std::string_view path)
+            : path_(path)
+    {
+        assert(!path.empty() && path.length() < sizeof(addr_.sun_path)); // 路径长度受限于sun_path
+        std::memset(&addr_, 0, sizeof(addr_));
+        addr_.sun_family = AF_UNIX;
+        std::memcpy(addr_.sun_path, path.data(), path.length());
+        if (isAbstract()) {
+            addr_.sun_path[0] = '\0';
+        }
+        len_ = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.length() + (isAbstract() ? 0 : 1));
+    }
+
+    const struct sockaddr* getSockaddr() const {
+        return reinterpret_cast<const struct sockaddr*>(&addr_);
+    }
+
+    socklen_t getSocklen() const {
+        return len_;
+    }
+
+    const std::string& path() const {
+        return path_;
+    }
+
+    bool isAbstract() const {
+        return path_[0] == '@';
+    }
+
+private:
+    std::string path_;
+    struct sockaddr_un addr_;
+    socklen_t len_;
+}; // class UnixAddress
+
+} // namespace rpc
+
+} // namespace mudong
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
 
 #include <mudong-json/include/Value.hpp>
@@ -16,6 +20,8 @@
 #include <mudong-ev/src/ThreadPool.hpp>
 #include <mudong-ev/src/CountDownLatch.hpp>
 
+#include "utils/RpcError.hpp"
+
 namespace mudong {
 
 namespace rpc {
@@ -27,6 +33,7 @@ using std::placeholders::_1;
 using std::placeholders::_2;
 using std::placeholders::_3;
 using std::placeholders::_4;
+using std::placeholders::_5;
 
 using ev::EventLoop;
 using ev::TcpConnection;
@@ -42,14 +49,61 @@ using ev::CountDownLatch;
 
 using RpcDoneCallback = std::function<void(json::Value response)>;
 
+// 请求的截止时间，由client在请求中附带的"timeout"字段（毫秒）加上server收到请求的时间得到
+using SteadyClock = std::chrono::steady_clock;
+using Deadline = SteadyClock::time_point;
+constexpr Deadline kNoDeadline = Deadline::max();
+
+// 方法的延迟等级，spec.json中以"priority"声明。IO线程和线程池都优先调度INTERACTIVE，BULK不会被饿死，见server/Executor.hpp
+enum class Priority {
+    INTERACTIVE,
+    BULK,
+};
+
+// 保留方法，返回server上所有方法名到数字id的映射，client之后可以用id代替方法名，见RpcServer::handleMethodIds
+constexpr std::string_view kMethodIdsMethod = "rpc.methods";
+
+// 保留方法，params为{"topic":...}，订阅或退订server推送的通知，见server/PubSub.hpp
+constexpr std::string_view kSubscribeMethod = "rpc.subscribe";
+constexpr std::string_view kUnsubscribeMethod = "rpc.unsubscribe";
+
+// server开始退出时向每个连接推送的通知，没有params；client收到后应改连其他server，见BaseServer::drain
+constexpr std::string_view kDrainNotice = "rpc.drain";
+
+// 与BaseServer::wrapException格式相同的error response
+inline json::Value errorResponse(const json::Value& id, const RpcError& err, const char* detail) {
+    json::Value response(json::ValueType::TYPE_OBJECT);
+    response.addMember("jsonrpc", "2.0");
+    auto& value = response.addMember("error", json::ValueType::TYPE_OBJECT);
+    value.addMember("code", err.asCode());
+    value.addMember("message", err.asString());
+    value.addMember("data", detail);
+    response.addMember("id", id);
+    return response;
+}
+
 class UserDoneCallback {
 
 public:
-    UserDoneCallback(json::Value &request, const RpcDoneCallback &callback)
+    UserDoneCallback(json::Value &request, const RpcDoneCallback &callback, Deadline deadline = kNoDeadline)
             : request_(request),
-              callback_(callback)
+              callback_(callback),
+              deadline_(deadline)
     {}
 
+    // 距截止时间的剩余时间，耗时较长的handler可据此提前放弃；client没有设置timeout时为milliseconds::max()
+    std::chrono::milliseconds remaining() const {
+        if (deadline_ == kNoDeadline) {
+            return std::chrono::milliseconds::max();
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - SteadyClock::now());
+        return std::max(left, std::chrono::milliseconds::zero());
+    }
+
+    bool expired() const {
+        return deadline_ != kNoDeadline && SteadyClock::now() >= deadline_;
+    }
+
 
     void operator()(json::Value &&result) const {
         json::Value response(json::ValueType::TYPE_OBJECT);
@@ -59,12 +113,96 @@ public:
         callback_(response);
     }
 
+    // 以error response回复，格式与BaseServer::wrapException相同
+    void error(const RpcError& err, const char* detail) const {
+        callback_(errorResponse(request_["id"], err, detail));
+    }
+
 private:
     mutable json::Value request_;
     RpcDoneCallback callback_;
+    Deadline deadline_;
 
 }; // class UserDoneCallback
 
+// 流式响应的流量控制，由连接层实现：连接上待发送的数据超过高水位时不可写，降下来之后执行等待的callback
+class FlowControl {
+
+public:
+    virtual ~FlowControl() = default;
+
+    // 可在任意线程调用
+    virtual bool writable() const = 0;
+
+    // callback在连接的IO线程中执行，当前已经可写时也投递到IO线程
+    virtual void whenWritable(std::function<void()> callback) = 0;
+}; // class FlowControl
+
+using FlowControlPtr = std::shared_ptr<FlowControl>;
+
+// 客户端流式上传的接收端，见server/StreamReader.hpp
+class StreamReader;
+using StreamReaderPtr = std::shared_ptr<StreamReader>;
+
+// 流式响应中的一块，与最终的响应使用同一个id，以"stream"字段区分
+inline bool isStreamChunk(const json::Value& response) {
+    return response.isObject() && response.findMember("stream") != response.endMember();
+}
+
+/* spec.json中声明为stream的procedure通过StreamWriter逐块发送结果，每块是一个独立的帧：
+{"jsonrpc":"2.0","id":...,"stream":chunk}
+最后以end()发送普通的成功响应结束调用，result为发送的块数；出错时以error()结束，二者只能调用其一，之后不能再write。
+write返回false表示连接上待发送的数据已超过高水位，此时应暂停产生数据，在onWritable的callback中继续，两端的内存占用因此有界
+ */
+class StreamWriter {
+
+public:
+    StreamWriter(json::Value &request, const RpcDoneCallback &callback, const FlowControlPtr& flow)
+            : id_(request["id"]),
+              callback_(callback),
+              flow_(flow),
+              count_(std::make_shared<std::atomic<int64_t>>(0))
+    {}
+
+    bool write(json::Value &&chunk) const {
+        json::Value message(json::ValueType::TYPE_OBJECT);
+        message.addMember("jsonrpc", "2.0");
+        message.addMember("id", id_);
+        message.addMember("stream", chunk);
+        callback_(message);
+        count_->fetch_add(1, std::memory_order_relaxed);
+        return flow_ == nullptr || flow_->writable();
+    }
+
+    // callback在连接的IO线程中执行，耗时的生产者可在其中再投递到线程池
+    void onWritable(std::function<void()> callback) const {
+        if (flow_ != nullptr) {
+            flow_->whenWritable(std::move(callback));
+        }
+        else {
+            callback();
+        }
+    }
+
+    void end() const {
+        json::Value response(json::ValueType::TYPE_OBJECT);
+        response.addMember("jsonrpc", "2.0");
+        response.addMember("id", id_);
+        response.addMember("result", count_->load(std::memory_order_relaxed));
+        callback_(response);
+    }
+
+    void error(const RpcError& err, const char* detail) const {
+        callback_(errorResponse(id_, err, detail));
+    }
+
+private:
+    json::Value id_;
+    RpcDoneCallback callback_;
+    FlowControlPtr flow_;
+    std::shared_ptr<std::atomic<int64_t>> count_; // 拷贝之间共享
+}; // class StreamWriter
+
 } // namespace rpc
 
 } // namespace mudong
\ No newline at end of file